@@ -0,0 +1,346 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "Model.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+// World-space triangle, stored in BVH leaf order
+struct BVHTriangle {
+    glm::vec3 v0, v1, v2;
+};
+
+// 32-byte node. Interior nodes (count == 0) have their two children at leftFirst and leftFirst + 1;
+// leaves hold triangles [leftFirst, leftFirst + count).
+struct BVHNode {
+    glm::vec3 minAABB;
+    uint32_t  leftFirst;
+    glm::vec3 maxAABB;
+    uint32_t  count;
+};
+
+// Closest point to p on triangle abc (Ericson, Real-Time Collision Detection 5.1.5)
+inline glm::vec3 ClosestPointOnTriangle(const glm::vec3 &p, const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c)
+{
+    glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+    float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f) return a;
+
+    glm::vec3 bp = p - b;
+    float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3) return b;
+
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+        return a + ab * (d1 / (d1 - d3));
+
+    glm::vec3 cp = p - c;
+    float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6) return c;
+
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+        return a + ac * (d2 / (d2 - d6));
+
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+        return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+    float denom = 1.0f / (va + vb + vc);
+    return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+// Static bounding volume hierarchy over a model's triangles, built with the binned surface area
+// heuristic and flattened into one node array. Used for the plane-vs-city collision.
+class BVH
+{
+public:
+    static const uint32_t MAX_DEPTH = 48;       // bounds the depth-first traversal stacks (here and in SceneQuery)
+
+    std::vector<BVHNode>     nodes;
+    std::vector<BVHTriangle> triangles;
+
+    bool empty() const { return nodes.empty(); }
+
+    // Builds over every triangle of model (LOD 0), transformed to world space by transform.
+    // CPU only (reads the meshes' vertex/index data), so it can run on a worker thread.
+    void build(const Model &model, const glm::mat4 &transform)
+    {
+        std::vector<BVHTriangle> source;
+        for (const Mesh &mesh : model.meshes)
+        {
+            const Vertex *vertices = mesh.vertexData();
+            const unsigned int *indices = mesh.indexData() + mesh.lods[0].firstIndex;
+            size_t vertexCount = mesh.vertexCount();
+            for (size_t i = 0; i + 2 < mesh.lods[0].indexCount; i += 3)
+            {
+                if (indices[i] >= vertexCount || indices[i + 1] >= vertexCount || indices[i + 2] >= vertexCount)
+                    continue;
+                BVHTriangle triangle;
+                triangle.v0 = glm::vec3(transform * glm::vec4(vertices[indices[i]].Position, 1.0f));
+                triangle.v1 = glm::vec3(transform * glm::vec4(vertices[indices[i + 1]].Position, 1.0f));
+                triangle.v2 = glm::vec3(transform * glm::vec4(vertices[indices[i + 2]].Position, 1.0f));
+                source.push_back(triangle);
+            }
+        }
+        build(source);
+    }
+
+    void build(const std::vector<BVHTriangle> &source)
+    {
+        nodes.clear();
+        triangles.clear();
+        if (source.empty())
+            return;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        size_t count = source.size();
+        centroids.resize(count);
+        boxMin.resize(count);
+        boxMax.resize(count);
+        order.resize(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            const BVHTriangle &t = source[i];
+            boxMin[i] = glm::min(t.v0, glm::min(t.v1, t.v2));
+            boxMax[i] = glm::max(t.v0, glm::max(t.v1, t.v2));
+            centroids[i] = (t.v0 + t.v1 + t.v2) * (1.0f / 3.0f);
+            order[i] = (uint32_t)i;
+        }
+
+        nodes.reserve(count * 2 / MIN_LEAF_SIZE + 1);
+        BVHNode root;
+        root.leftFirst = 0;
+        root.count = (uint32_t)count;
+        nodes.push_back(root);
+        updateBounds(0);
+
+        // Split nodes depth-first from an explicit stack, so degenerate input can't overflow the call stack
+        std::vector<uint32_t> pending(1, 0);
+        depth = 1;
+        std::vector<uint32_t> nodeDepth(1, 1);
+        while (!pending.empty())
+        {
+            uint32_t index = pending.back();
+            pending.pop_back();
+            uint32_t childLevel = nodeDepth[index] + 1;
+            if (childLevel > MAX_DEPTH || !subdivide(index))
+                continue;
+            uint32_t left = nodes[index].leftFirst;
+            nodeDepth.resize(nodes.size());
+            nodeDepth[left] = nodeDepth[left + 1] = childLevel;
+            depth = std::max(depth, childLevel);
+            pending.push_back(left);
+            pending.push_back(left + 1);
+        }
+
+        triangles.resize(count);
+        for (size_t i = 0; i < count; i++)
+            triangles[i] = source[order[i]];
+
+        centroids.clear(); centroids.shrink_to_fit();
+        boxMin.clear(); boxMin.shrink_to_fit();
+        boxMax.clear(); boxMax.shrink_to_fit();
+        order.clear(); order.shrink_to_fit();
+        buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // True if the sphere touches any triangle. Visits only nodes whose box the sphere overlaps.
+    bool intersectsSphere(const glm::vec3 &center, float radius) const
+    {
+        if (nodes.empty())
+            return false;
+        float radiusSq = radius * radius;
+        uint32_t stack[MAX_DEPTH + 1];  // depth-first, so at most one pending sibling per level
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0)
+        {
+            const BVHNode &node = nodes[stack[--top]];
+            if (distanceSqToBox(center, node.minAABB, node.maxAABB) > radiusSq)
+                continue;
+            if (node.count > 0)
+            {
+                for (uint32_t i = node.leftFirst; i < node.leftFirst + node.count; i++)
+                {
+                    const BVHTriangle &t = triangles[i];
+                    glm::vec3 offset = ClosestPointOnTriangle(center, t.v0, t.v1, t.v2) - center;
+                    if (glm::dot(offset, offset) <= radiusSq)
+                        return true;
+                }
+            }
+            else
+            {
+                stack[top++] = node.leftFirst + 1;
+                stack[top++] = node.leftFirst;
+            }
+        }
+        return false;
+    }
+
+    void printStats(const std::string &label) const
+    {
+        size_t leaves = 0;
+        for (const BVHNode &node : nodes)
+            if (node.count > 0)
+                leaves++;
+        std::cout << "BVH " << label << ": " << triangles.size() << " triangles, " << nodes.size() << " nodes ("
+                  << leaves << " leaves), depth " << depth << ", "
+                  << (nodes.size() * sizeof(BVHNode) + triangles.size() * sizeof(BVHTriangle)) / 1024 << " KB, built in "
+                  << buildMs << " ms" << std::endl;
+    }
+
+private:
+    static const uint32_t MIN_LEAF_SIZE = 2;    // never split below this
+    static const uint32_t MAX_LEAF_SIZE = 16;   // always split above this, even if SAH says not to
+    static const int SAH_BINS = 12;
+
+    // Build-time scratch, indexed by source triangle
+    std::vector<glm::vec3> centroids, boxMin, boxMax;
+    std::vector<uint32_t>  order;
+    uint32_t depth = 0;
+    double buildMs = 0.0;
+
+    static float distanceSqToBox(const glm::vec3 &p, const glm::vec3 &minAABB, const glm::vec3 &maxAABB)
+    {
+        glm::vec3 closest = glm::clamp(p, minAABB, maxAABB);
+        glm::vec3 offset = closest - p;
+        return glm::dot(offset, offset);
+    }
+
+    static float surfaceArea(const glm::vec3 &minAABB, const glm::vec3 &maxAABB)
+    {
+        glm::vec3 e = maxAABB - minAABB;
+        return e.x * e.y + e.y * e.z + e.z * e.x;
+    }
+
+    void updateBounds(uint32_t index)
+    {
+        BVHNode &node = nodes[index];
+        node.minAABB = glm::vec3(1e30f);
+        node.maxAABB = glm::vec3(-1e30f);
+        for (uint32_t i = node.leftFirst; i < node.leftFirst + node.count; i++)
+        {
+            node.minAABB = glm::min(node.minAABB, boxMin[order[i]]);
+            node.maxAABB = glm::max(node.maxAABB, boxMax[order[i]]);
+        }
+    }
+
+    // Splits node index in two using the binned SAH. Returns false if it stays a leaf.
+    bool subdivide(uint32_t index)
+    {
+        BVHNode node = nodes[index];
+        if (node.count <= MIN_LEAF_SIZE)
+            return false;
+
+        glm::vec3 centroidMin(1e30f), centroidMax(-1e30f);
+        for (uint32_t i = node.leftFirst; i < node.leftFirst + node.count; i++)
+        {
+            centroidMin = glm::min(centroidMin, centroids[order[i]]);
+            centroidMax = glm::max(centroidMax, centroids[order[i]]);
+        }
+
+        int bestAxis = -1;
+        int bestSplit = 0;
+        float bestCost = 1e30f;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float extent = centroidMax[axis] - centroidMin[axis];
+            if (extent <= 0.0f)
+                continue;
+            struct Bin { glm::vec3 minAABB = glm::vec3(1e30f), maxAABB = glm::vec3(-1e30f); uint32_t count = 0; };
+            Bin bins[SAH_BINS];
+            float scale = SAH_BINS / extent;
+            for (uint32_t i = node.leftFirst; i < node.leftFirst + node.count; i++)
+            {
+                uint32_t t = order[i];
+                int b = std::min(SAH_BINS - 1, (int)((centroids[t][axis] - centroidMin[axis]) * scale));
+                bins[b].count++;
+                bins[b].minAABB = glm::min(bins[b].minAABB, boxMin[t]);
+                bins[b].maxAABB = glm::max(bins[b].maxAABB, boxMax[t]);
+            }
+
+            // Sweep from both sides to get the area and count left/right of each of the SAH_BINS - 1 planes
+            float leftArea[SAH_BINS - 1], rightArea[SAH_BINS - 1];
+            uint32_t leftCount[SAH_BINS - 1], rightCount[SAH_BINS - 1];
+            glm::vec3 leftMin(1e30f), leftMax(-1e30f), rightMin(1e30f), rightMax(-1e30f);
+            uint32_t leftSum = 0, rightSum = 0;
+            for (int i = 0; i < SAH_BINS - 1; i++)
+            {
+                leftSum += bins[i].count;
+                leftCount[i] = leftSum;
+                leftMin = glm::min(leftMin, bins[i].minAABB);
+                leftMax = glm::max(leftMax, bins[i].maxAABB);
+                leftArea[i] = leftSum > 0 ? surfaceArea(leftMin, leftMax) : 0.0f;
+
+                int j = SAH_BINS - 1 - i;
+                rightSum += bins[j].count;
+                rightCount[j - 1] = rightSum;
+                rightMin = glm::min(rightMin, bins[j].minAABB);
+                rightMax = glm::max(rightMax, bins[j].maxAABB);
+                rightArea[j - 1] = rightSum > 0 ? surfaceArea(rightMin, rightMax) : 0.0f;
+            }
+            for (int i = 0; i < SAH_BINS - 1; i++)
+            {
+                if (leftCount[i] == 0 || rightCount[i] == 0)
+                    continue;
+                float cost = leftCount[i] * leftArea[i] + rightCount[i] * rightArea[i];
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = i;
+                }
+            }
+        }
+
+        // Traversal cost 1, intersection cost 1, both relative to the parent's area
+        float parentArea = surfaceArea(node.minAABB, node.maxAABB);
+        float leafCost = (float)node.count;
+        float splitCost = parentArea > 0.0f ? 1.0f + bestCost / parentArea : 1e30f;
+
+        uint32_t first = node.leftFirst, last = node.leftFirst + node.count;
+        uint32_t middle;
+        if (bestAxis >= 0 && (splitCost < leafCost || node.count > MAX_LEAF_SIZE))
+        {
+            float extent = centroidMax[bestAxis] - centroidMin[bestAxis];
+            float scale = SAH_BINS / extent;
+            uint32_t *split = std::partition(order.data() + first, order.data() + last, [&](uint32_t t) {
+                int b = std::min(SAH_BINS - 1, (int)((centroids[t][bestAxis] - centroidMin[bestAxis]) * scale));
+                return b <= bestSplit;
+            });
+            middle = (uint32_t)(split - order.data());
+        }
+        else if (node.count > MAX_LEAF_SIZE)
+        {
+            // All centroids coincide (or SAH found nothing): split the list in half so leaves stay small
+            middle = first + node.count / 2;
+        }
+        else
+        {
+            return false;
+        }
+        if (middle == first || middle == last)
+            return false;
+
+        uint32_t left = (uint32_t)nodes.size();
+        BVHNode child;
+        child.leftFirst = first;
+        child.count = middle - first;
+        nodes.push_back(child);
+        child.leftFirst = middle;
+        child.count = last - middle;
+        nodes.push_back(child);
+        updateBounds(left);
+        updateBounds(left + 1);
+
+        nodes[index].leftFirst = left;
+        nodes[index].count = 0;
+        return true;
+    }
+};
@@ -2,6 +2,7 @@
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include "Frustum.h"
 #include <vector>
 
 // Defines several possible options for camera movement.
@@ -29,6 +30,7 @@ public:
     // --- New Orbit Camera Members ---
     glm::vec3 Target;      // The point the camera is looking at
     float Distance;        // The distance from the target
+    float CollisionDistance; // Distance actually used, pulled in when scenery blocks the view
 
     // camera Attributes
     glm::vec3 Position;
@@ -48,6 +50,7 @@ public:
     {
         Target = target;
         Distance = 15.0f; // Start 15 units away from the target
+        CollisionDistance = Distance;
         WorldUp = up;
         Yaw = yaw;
         Pitch = pitch;
@@ -62,6 +65,20 @@ public:
         return glm::lookAt(Position, Target, Up);
     }
 
+    // Unit vector from the target towards the camera (before any collision pull-in)
+    glm::vec3 OrbitDirection() const
+    {
+        return glm::vec3(cos(glm::radians(Yaw)) * cos(glm::radians(Pitch)),
+                         sin(glm::radians(Pitch)),
+                         sin(glm::radians(Yaw)) * cos(glm::radians(Pitch)));
+    }
+
+    // View volume for projection and the current view (same as the last GetViewMatrix()), for culling
+    Frustum GetFrustum(const glm::mat4 &projection) const
+    {
+        return Frustum::fromMatrix(projection * glm::lookAt(Position, Target, Up));
+    }
+
     // Processes input received from the mouse.
     void ProcessMouseMovement(float xoffset, float yoffset)
     {
@@ -99,10 +116,8 @@ private:
     void updateCameraVectors()
     {
         // Calculate the new camera position using spherical coordinates
-        float x = Target.x + Distance * cos(glm::radians(Yaw)) * cos(glm::radians(Pitch));
-        float y = Target.y + Distance * sin(glm::radians(Pitch));
-        float z = Target.z + Distance * sin(glm::radians(Yaw)) * cos(glm::radians(Pitch));
-        Position = glm::vec3(x, y, z);
+        float distance = CollisionDistance < Distance ? CollisionDistance : Distance;
+        Position = Target + OrbitDirection() * distance;
 
         // Recalculate the direction vectors
         Front = glm::normalize(Target - Position);
@@ -0,0 +1,299 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "JobSystem.h"
+#include "SimKernels.h"
+
+#include <cstdint>
+#include <vector>
+
+// Entities per job when a pool update is spread over the JobSystem; a multiple of the widest
+// SIMD kernel so only the last range has a scalar tail
+const uint32_t ENTITY_JOB_GRAIN = 4096;
+
+// Refers to one pooled entity. Stays valid while the entity is moved around inside its pool, and stops
+// resolving once it's removed, even if the slot has since been reused (the generation won't match).
+struct EntityHandle {
+    uint32_t slot = 0xFFFFFFFF;
+    uint32_t generation = 0;
+};
+
+// Handle bookkeeping shared by the pools below. Entities live at dense indices 0..size()-1; a slot
+// table maps each handle to its current index. Removing index i moves the last entity into i, and
+// every pool moves its arrays the same way (swapRemove), so removal is O(1) with no gaps to skip.
+class EntityHandles
+{
+public:
+    uint32_t size() const { return (uint32_t)indexToSlot.size(); }
+
+    // Handle for a new entity at index size() (the pool pushes its data right after)
+    EntityHandle add()
+    {
+        uint32_t slot;
+        if (!freeSlots.empty())
+        {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        }
+        else
+        {
+            slot = (uint32_t)slotToIndex.size();
+            slotToIndex.push_back(0);
+            generations.push_back(0);
+        }
+        slotToIndex[slot] = size();
+        indexToSlot.push_back(slot);
+        EntityHandle handle;
+        handle.slot = slot;
+        handle.generation = generations[slot];
+        return handle;
+    }
+
+    void swapRemove(uint32_t index)
+    {
+        uint32_t slot = indexToSlot[index];
+        generations[slot]++;
+        freeSlots.push_back(slot);
+
+        uint32_t last = indexToSlot.back();
+        indexToSlot[index] = last;
+        slotToIndex[last] = index;
+        indexToSlot.pop_back();
+    }
+
+    // Current index of the entity, or -1 if it has been removed
+    int indexOf(EntityHandle handle) const
+    {
+        if (handle.slot >= generations.size() || generations[handle.slot] != handle.generation)
+            return -1;
+        return (int)slotToIndex[handle.slot];
+    }
+
+    EntityHandle handleAt(uint32_t index) const
+    {
+        EntityHandle handle;
+        handle.slot = indexToSlot[index];
+        handle.generation = generations[handle.slot];
+        return handle;
+    }
+
+private:
+    std::vector<uint32_t> slotToIndex;
+    std::vector<uint32_t> indexToSlot;
+    std::vector<uint32_t> generations;
+    std::vector<uint32_t> freeSlots;
+};
+
+template <typename T>
+inline void SwapRemove(std::vector<T> &values, uint32_t index)
+{
+    values[index] = values.back();
+    values.pop_back();
+}
+
+// Enemy planes, one array per field. x/y/z are split so the update kernels run straight down the arrays.
+class EnemyPool
+{
+public:
+    EntityHandles handles;
+    std::vector<float> posX, posY, posZ;
+    std::vector<float> targetX, targetY, targetZ;   // where it's currently going
+    std::vector<float> speed;
+    std::vector<float> yaw;                         // radians, about +Y
+    std::vector<float> propellerAngle;              // degrees
+    std::vector<unsigned char> reachedTarget;       // written by steer(), 1 if within reach of its target
+    // State at the start of the current step (see beginStep), for drawing between steps
+    std::vector<float> previousX, previousY, previousZ;
+    std::vector<float> previousYaw, previousPropellerAngle;
+
+    uint32_t size() const { return handles.size(); }
+    bool empty() const { return size() == 0; }
+
+    EntityHandle spawn(const glm::vec3 &pos, const glm::vec3 &target, float enemySpeed)
+    {
+        EntityHandle handle = handles.add();
+        posX.push_back(pos.x); posY.push_back(pos.y); posZ.push_back(pos.z);
+        targetX.push_back(target.x); targetY.push_back(target.y); targetZ.push_back(target.z);
+        speed.push_back(enemySpeed);
+        yaw.push_back(0.0f);
+        propellerAngle.push_back(0.0f);
+        reachedTarget.push_back(0);
+        previousX.push_back(pos.x); previousY.push_back(pos.y); previousZ.push_back(pos.z);
+        previousYaw.push_back(0.0f);
+        previousPropellerAngle.push_back(0.0f);
+        return handle;
+    }
+
+    void remove(uint32_t index)
+    {
+        handles.swapRemove(index);
+        SwapRemove(posX, index); SwapRemove(posY, index); SwapRemove(posZ, index);
+        SwapRemove(targetX, index); SwapRemove(targetY, index); SwapRemove(targetZ, index);
+        SwapRemove(speed, index);
+        SwapRemove(yaw, index);
+        SwapRemove(propellerAngle, index);
+        SwapRemove(reachedTarget, index);
+        SwapRemove(previousX, index); SwapRemove(previousY, index); SwapRemove(previousZ, index);
+        SwapRemove(previousYaw, index);
+        SwapRemove(previousPropellerAngle, index);
+    }
+
+    void beginStep()
+    {
+        previousX = posX; previousY = posY; previousZ = posZ;
+        previousYaw = yaw;
+        previousPropellerAngle = propellerAngle;
+    }
+
+    glm::vec3 position(uint32_t i) const { return glm::vec3(posX[i], posY[i], posZ[i]); }
+    glm::vec3 previousPosition(uint32_t i) const { return glm::vec3(previousX[i], previousY[i], previousZ[i]); }
+    glm::vec3 target(uint32_t i) const { return glm::vec3(targetX[i], targetY[i], targetZ[i]); }
+    void setTarget(uint32_t i, const glm::vec3 &t) { targetX[i] = t.x; targetY[i] = t.y; targetZ[i] = t.z; }
+
+    // Flies every enemy towards its target on the horizontal plane, or straight up where blocked[i]
+    // is set (one entry per enemy). Updates yaw to face the target, spins the propeller and flags
+    // reachedTarget for enemies within reach of their target. Runs the SimKernels batch kernel,
+    // split into ENTITY_JOB_GRAIN ranges over the JobSystem.
+    void steer(float deltaTime, const std::vector<unsigned char> &blocked, float reach)
+    {
+        EnemySteerBatch batch;
+        batch.posX = posX.data(); batch.posY = posY.data(); batch.posZ = posZ.data();
+        batch.targetX = targetX.data(); batch.targetZ = targetZ.data();
+        batch.speed = speed.data();
+        batch.yaw = yaw.data();
+        batch.propellerAngle = propellerAngle.data();
+        batch.blocked = blocked.data();
+        batch.reachedTarget = reachedTarget.data();
+        batch.count = size();
+        batch.deltaTime = deltaTime;
+        batch.reach = reach;
+        JobSystem::instance().parallelFor(batch.count, ENTITY_JOB_GRAIN, [&batch](uint32_t begin, uint32_t end) {
+            SimKernels::steerEnemies(batch.slice(begin, end));
+        });
+    }
+};
+
+// Bullets
+class ProjectilePool
+{
+public:
+    EntityHandles handles;
+    std::vector<float> posX, posY, posZ;
+    std::vector<float> velX, velY, velZ;
+    std::vector<float> life;            // seconds left; removeExpired() drops those at or below 0
+    std::vector<float> previousX, previousY, previousZ;   // position at the start of the current step
+
+    uint32_t size() const { return handles.size(); }
+    bool empty() const { return size() == 0; }
+
+    EntityHandle spawn(const glm::vec3 &pos, const glm::vec3 &vel, float lifetime)
+    {
+        EntityHandle handle = handles.add();
+        posX.push_back(pos.x); posY.push_back(pos.y); posZ.push_back(pos.z);
+        velX.push_back(vel.x); velY.push_back(vel.y); velZ.push_back(vel.z);
+        life.push_back(lifetime);
+        previousX.push_back(pos.x); previousY.push_back(pos.y); previousZ.push_back(pos.z);
+        return handle;
+    }
+
+    void remove(uint32_t index)
+    {
+        handles.swapRemove(index);
+        SwapRemove(posX, index); SwapRemove(posY, index); SwapRemove(posZ, index);
+        SwapRemove(velX, index); SwapRemove(velY, index); SwapRemove(velZ, index);
+        SwapRemove(life, index);
+        SwapRemove(previousX, index); SwapRemove(previousY, index); SwapRemove(previousZ, index);
+    }
+
+    void beginStep()
+    {
+        previousX = posX; previousY = posY; previousZ = posZ;
+    }
+
+    glm::vec3 position(uint32_t i) const { return glm::vec3(posX[i], posY[i], posZ[i]); }
+    glm::vec3 previousPosition(uint32_t i) const { return glm::vec3(previousX[i], previousY[i], previousZ[i]); }
+    glm::vec3 velocity(uint32_t i) const { return glm::vec3(velX[i], velY[i], velZ[i]); }
+
+    void integrate(float deltaTime)
+    {
+        ProjectileBatch batch;
+        batch.posX = posX.data(); batch.posY = posY.data(); batch.posZ = posZ.data();
+        batch.velX = velX.data(); batch.velY = velY.data(); batch.velZ = velZ.data();
+        batch.life = life.data();
+        batch.count = size();
+        batch.deltaTime = deltaTime;
+        JobSystem::instance().parallelFor(batch.count, ENTITY_JOB_GRAIN, [&batch](uint32_t begin, uint32_t end) {
+            SimKernels::integrateProjectiles(batch.slice(begin, end));
+        });
+    }
+
+    void removeExpired()
+    {
+        for (uint32_t i = 0; i < size();)
+        {
+            if (life[i] <= 0.0f)
+                remove(i);  // the last bullet moves into i, check it next
+            else
+                i++;
+        }
+    }
+};
+
+// Explosion puffs
+class ExplosionPool
+{
+public:
+    EntityHandles handles;
+    std::vector<float> posX, posY, posZ;
+    std::vector<float> life;            // seconds left
+    std::vector<float> totalLife;
+    std::vector<float> previousLife;    // at the start of the current step
+
+    uint32_t size() const { return handles.size(); }
+    bool empty() const { return size() == 0; }
+
+    EntityHandle spawn(const glm::vec3 &pos, float duration)
+    {
+        EntityHandle handle = handles.add();
+        posX.push_back(pos.x); posY.push_back(pos.y); posZ.push_back(pos.z);
+        life.push_back(duration);
+        totalLife.push_back(duration);
+        previousLife.push_back(duration);
+        return handle;
+    }
+
+    void remove(uint32_t index)
+    {
+        handles.swapRemove(index);
+        SwapRemove(posX, index); SwapRemove(posY, index); SwapRemove(posZ, index);
+        SwapRemove(life, index);
+        SwapRemove(totalLife, index);
+        SwapRemove(previousLife, index);
+    }
+
+    void beginStep() { previousLife = life; }
+
+    glm::vec3 position(uint32_t i) const { return glm::vec3(posX[i], posY[i], posZ[i]); }
+    // 0 when it starts, 1 when it's over
+    float progress(uint32_t i) const { return 1.0f - life[i] / totalLife[i]; }
+    float previousProgress(uint32_t i) const { return 1.0f - previousLife[i] / totalLife[i]; }
+
+    void age(float deltaTime)
+    {
+        uint32_t count = size();
+        for (uint32_t i = 0; i < count; i++)
+            life[i] -= deltaTime;
+    }
+
+    void removeExpired()
+    {
+        for (uint32_t i = 0; i < size();)
+        {
+            if (life[i] <= 0.0f)
+                remove(i);
+            else
+                i++;
+        }
+    }
+};
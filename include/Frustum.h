@@ -0,0 +1,188 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "JobSystem.h"
+
+#include <atomic>
+#include <cmath>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FRUSTUM_SSE 1
+#endif
+
+// The six planes of a view volume, as (normal, d) with normals pointing inside:
+// a point p is inside a plane when dot(normal, p) + d >= 0.
+struct Frustum {
+    glm::vec4 planes[6];
+
+    // Planes of the clip volume of viewProjection (Gribb/Hartmann), e.g. projection * view
+    // for the camera or the light-space matrix for the shadow pass.
+    static Frustum fromMatrix(const glm::mat4 &m)
+    {
+        glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+        glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+        glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+        glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+        Frustum frustum;
+        frustum.planes[0] = row3 + row0;   // left
+        frustum.planes[1] = row3 - row0;   // right
+        frustum.planes[2] = row3 + row1;   // bottom
+        frustum.planes[3] = row3 - row1;   // top
+        frustum.planes[4] = row3 + row2;   // near
+        frustum.planes[5] = row3 - row2;   // far
+        for (glm::vec4 &plane : frustum.planes)
+        {
+            float length = std::sqrt(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z);
+            if (length > 0.0f)
+                plane = plane * (1.0f / length);
+        }
+        return frustum;
+    }
+
+    // Conservative box test: false only if the box is entirely outside one plane
+    bool intersects(const glm::vec3 &center, const glm::vec3 &extent) const
+    {
+        for (const glm::vec4 &plane : planes)
+        {
+            float distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+            float radius = std::fabs(plane.x) * extent.x + std::fabs(plane.y) * extent.y + std::fabs(plane.z) * extent.z;
+            if (distance + radius < 0.0f)
+                return false;
+        }
+        return true;
+    }
+
+    bool intersectsSphere(const glm::vec3 &center, float radius) const
+    {
+        return intersects(center, glm::vec3(radius));
+    }
+};
+
+// World-space bounds of a local AABB under transform (the box around the transformed box).
+inline void TransformAABB(const glm::vec3 &minAABB, const glm::vec3 &maxAABB, const glm::mat4 &transform,
+                          glm::vec3 &outCenter, glm::vec3 &outExtent)
+{
+    glm::vec3 center = (minAABB + maxAABB) * 0.5f;
+    glm::vec3 extent = (maxAABB - minAABB) * 0.5f;
+    outCenter = glm::vec3(transform * glm::vec4(center, 1.0f));
+    for (int row = 0; row < 3; row++)
+        outExtent[row] = std::fabs(transform[0][row]) * extent.x
+                       + std::fabs(transform[1][row]) * extent.y
+                       + std::fabs(transform[2][row]) * extent.z;
+}
+
+// World-space boxes stored as separate center/extent arrays, so CullBatch can test four at once.
+struct BoundsBatch {
+    std::vector<float> centerX, centerY, centerZ;
+    std::vector<float> extentX, extentY, extentZ;
+
+    size_t size() const { return centerX.size(); }
+
+    void clear()
+    {
+        centerX.clear(); centerY.clear(); centerZ.clear();
+        extentX.clear(); extentY.clear(); extentZ.clear();
+    }
+
+    void add(const glm::vec3 &center, const glm::vec3 &extent)
+    {
+        centerX.push_back(center.x); centerY.push_back(center.y); centerZ.push_back(center.z);
+        extentX.push_back(extent.x); extentY.push_back(extent.y); extentZ.push_back(extent.z);
+    }
+
+    void addSphere(const glm::vec3 &center, float radius) { add(center, glm::vec3(radius)); }
+
+    void addTransformed(const glm::vec3 &minAABB, const glm::vec3 &maxAABB, const glm::mat4 &transform)
+    {
+        glm::vec3 center, extent;
+        TransformAABB(minAABB, maxAABB, transform, center, extent);
+        add(center, extent);
+    }
+};
+
+// Objects tested / left visible by one pass this frame
+struct CullStats {
+    unsigned int tested = 0;
+    unsigned int visible = 0;
+
+    unsigned int culled() const { return tested - visible; }
+    void add(unsigned int testedCount, unsigned int visibleCount) { tested += testedCount; visible += visibleCount; }
+};
+
+// Boxes per job when CullBatch is spread over the JobSystem (a multiple of the SSE width)
+const uint32_t CULL_JOB_GRAIN = 2048;
+
+// CullBatch over boxes [begin, end) only; visible must already hold every box
+inline unsigned int CullRange(const Frustum &frustum, const BoundsBatch &bounds, size_t begin, size_t end,
+                              std::vector<unsigned char> &visible)
+{
+    unsigned int visibleCount = 0;
+    size_t i = begin;
+
+#ifdef FRUSTUM_SSE
+    __m128 nx[6], ny[6], nz[6], nd[6], ax[6], ay[6], az[6];
+    for (int p = 0; p < 6; p++)
+    {
+        const glm::vec4 &plane = frustum.planes[p];
+        nx[p] = _mm_set1_ps(plane.x);
+        ny[p] = _mm_set1_ps(plane.y);
+        nz[p] = _mm_set1_ps(plane.z);
+        nd[p] = _mm_set1_ps(plane.w);
+        ax[p] = _mm_set1_ps(std::fabs(plane.x));
+        ay[p] = _mm_set1_ps(std::fabs(plane.y));
+        az[p] = _mm_set1_ps(std::fabs(plane.z));
+    }
+    const __m128 zero = _mm_setzero_ps();
+    for (; i + 4 <= end; i += 4)
+    {
+        __m128 cx = _mm_loadu_ps(&bounds.centerX[i]);
+        __m128 cy = _mm_loadu_ps(&bounds.centerY[i]);
+        __m128 cz = _mm_loadu_ps(&bounds.centerZ[i]);
+        __m128 ex = _mm_loadu_ps(&bounds.extentX[i]);
+        __m128 ey = _mm_loadu_ps(&bounds.extentY[i]);
+        __m128 ez = _mm_loadu_ps(&bounds.extentZ[i]);
+        __m128 outside = zero;
+        for (int p = 0; p < 6; p++)
+        {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx[p], cx), _mm_mul_ps(ny[p], cy)),
+                                         _mm_add_ps(_mm_mul_ps(nz[p], cz), nd[p]));
+            __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax[p], ex), _mm_mul_ps(ay[p], ey)), _mm_mul_ps(az[p], ez));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), zero));
+        }
+        int mask = _mm_movemask_ps(outside);
+        for (int lane = 0; lane < 4; lane++)
+        {
+            unsigned char inside = (mask & (1 << lane)) ? 0 : 1;
+            visible[i + lane] = inside;
+            visibleCount += inside;
+        }
+    }
+#endif
+
+    for (; i < end; i++)
+    {
+        glm::vec3 center(bounds.centerX[i], bounds.centerY[i], bounds.centerZ[i]);
+        glm::vec3 extent(bounds.extentX[i], bounds.extentY[i], bounds.extentZ[i]);
+        unsigned char inside = frustum.intersects(center, extent) ? 1 : 0;
+        visible[i] = inside;
+        visibleCount += inside;
+    }
+    return visibleCount;
+}
+
+// Tests every box in bounds against frustum. visible[i] is 1 if box i may be inside, 0 if it's
+// certainly outside. Returns the number of visible boxes. Four boxes per iteration with SSE, and
+// CULL_JOB_GRAIN boxes per job for big batches (the whole city).
+inline unsigned int CullBatch(const Frustum &frustum, const BoundsBatch &bounds, std::vector<unsigned char> &visible)
+{
+    visible.resize(bounds.size());
+    std::atomic<unsigned int> visibleCount(0);
+    JobSystem::instance().parallelFor((uint32_t)bounds.size(), CULL_JOB_GRAIN, [&](uint32_t begin, uint32_t end) {
+        visibleCount.fetch_add(CullRange(frustum, bounds, begin, end, visible), std::memory_order_relaxed);
+    });
+    return visibleCount.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <glad/glad.h>
+
+// Shadow copy of the GL binding state, so redundant glUseProgram / glActiveTexture / glBindTexture /
+// glBindVertexArray / glBindFramebuffer calls are dropped before they reach the driver.
+// Everything on the context thread that binds these goes through here (Shader::use, Mesh,
+// UploadTexture, RenderQueue), otherwise the shadow copy goes stale.
+// Also counts what actually reached GL per frame, for the stats in the window title.
+class GLStateCache
+{
+public:
+    static const unsigned int MAX_TEXTURE_UNITS = 16;
+    static const int LOD_LEVELS = 4;    // MAX_MESH_LODS
+
+    struct Counters {
+        unsigned int programBinds = 0;
+        unsigned int textureUnitSwitches = 0;   // glActiveTexture
+        unsigned int textureBinds = 0;
+        unsigned int vertexArrayBinds = 0;
+        unsigned int framebufferBinds = 0;
+        unsigned int redundantSkipped = 0;      // binds dropped because the state was already set
+        unsigned int drawCalls = 0;
+        unsigned int instancedDrawCalls = 0;
+        unsigned int multiDrawCalls = 0;
+        unsigned int multiDrawRanges = 0;       // meshes drawn by those multi-draws
+        unsigned long long lodTriangles[LOD_LEVELS] = {};  // triangles drawn at each level of detail, all instances
+
+        unsigned int stateChanges() const
+        {
+            return programBinds + textureUnitSwitches + textureBinds + vertexArrayBinds + framebufferBinds;
+        }
+    };
+
+    static GLStateCache &instance()
+    {
+        static GLStateCache cache;
+        return cache;
+    }
+
+    void useProgram(unsigned int id)
+    {
+        if (program == id) { current.redundantSkipped++; return; }
+        glUseProgram(id);
+        program = id;
+        current.programBinds++;
+    }
+
+    void bindTexture2D(unsigned int unit, unsigned int id)
+    {
+        if (unit >= MAX_TEXTURE_UNITS)
+            return;
+        if (textures[unit] == id) { current.redundantSkipped++; return; }
+        if (activeUnit != unit)
+        {
+            glActiveTexture(GL_TEXTURE0 + unit);
+            activeUnit = unit;
+            current.textureUnitSwitches++;
+        }
+        glBindTexture(GL_TEXTURE_2D, id);
+        textures[unit] = id;
+        current.textureBinds++;
+    }
+
+    // GL_TEXTURE_2D_ARRAY binding, tracked separately from the unit's GL_TEXTURE_2D
+    void bindTexture2DArray(unsigned int unit, unsigned int id)
+    {
+        if (unit >= MAX_TEXTURE_UNITS)
+            return;
+        if (textureArrays[unit] == id) { current.redundantSkipped++; return; }
+        if (activeUnit != unit)
+        {
+            glActiveTexture(GL_TEXTURE0 + unit);
+            activeUnit = unit;
+            current.textureUnitSwitches++;
+        }
+        glBindTexture(GL_TEXTURE_2D_ARRAY, id);
+        textureArrays[unit] = id;
+        current.textureBinds++;
+    }
+
+    void bindVertexArray(unsigned int id)
+    {
+        if (vertexArray == id) { current.redundantSkipped++; return; }
+        glBindVertexArray(id);
+        vertexArray = id;
+        current.vertexArrayBinds++;
+    }
+
+    void bindFramebuffer(unsigned int id)
+    {
+        if (framebuffer == id) { current.redundantSkipped++; return; }
+        glBindFramebuffer(GL_FRAMEBUFFER, id);
+        framebuffer = id;
+        current.framebufferBinds++;
+    }
+
+    // Copies the depth buffer of framebuffer `from` into `to` (same size and format), leaving `to` bound
+    void blitDepth(unsigned int from, unsigned int to, int width, int height)
+    {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, from);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, to);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, to);
+        framebuffer = to;
+        current.framebufferBinds += 3;
+    }
+
+    void countDraw(int lod, unsigned int triangles)
+    {
+        current.drawCalls++;
+        current.lodTriangles[lod] += triangles;
+    }
+    void countInstancedDraw(int lod, unsigned int triangles, unsigned int instances)
+    {
+        current.drawCalls++;
+        current.instancedDrawCalls++;
+        current.lodTriangles[lod] += (unsigned long long)triangles * instances;
+    }
+    // One glMultiDraw* call of `ranges` draws; their triangles go through countTriangles
+    void countMultiDraw(unsigned int ranges)
+    {
+        current.drawCalls++;
+        current.multiDrawCalls++;
+        current.multiDrawRanges += ranges;
+    }
+    void countTriangles(int lod, unsigned int triangles) { current.lodTriangles[lod] += triangles; }
+
+    // GL unbinds deleted objects, so a later object reusing the name must not look "already bound"
+    void forgetTexture(unsigned int id)
+    {
+        for (unsigned int unit = 0; unit < MAX_TEXTURE_UNITS; unit++)
+        {
+            if (textures[unit] == id)
+                textures[unit] = UNKNOWN;
+            if (textureArrays[unit] == id)
+                textureArrays[unit] = UNKNOWN;
+        }
+    }
+    void forgetVertexArray(unsigned int id)
+    {
+        if (vertexArray == id)
+            vertexArray = UNKNOWN;
+    }
+
+    // For code that had to touch GL directly: the next bind of everything goes through
+    void invalidate()
+    {
+        program = activeUnit = vertexArray = framebuffer = UNKNOWN;
+        for (unsigned int unit = 0; unit < MAX_TEXTURE_UNITS; unit++)
+            textures[unit] = textureArrays[unit] = UNKNOWN;
+    }
+
+    // Call once per frame; lastFrame() then holds the counters of the frame that just ended
+    void endFrame()
+    {
+        previous = current;
+        current = Counters();
+    }
+    const Counters &lastFrame() const { return previous; }
+
+private:
+    static const unsigned int UNKNOWN = 0xFFFFFFFFu;
+
+    unsigned int program = UNKNOWN;
+    unsigned int activeUnit = UNKNOWN;
+    unsigned int textures[MAX_TEXTURE_UNITS];
+    unsigned int textureArrays[MAX_TEXTURE_UNITS];
+    unsigned int vertexArray = UNKNOWN;
+    unsigned int framebuffer = UNKNOWN;
+    Counters current, previous;
+
+    GLStateCache() { invalidate(); }
+};
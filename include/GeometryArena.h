@@ -0,0 +1,270 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "GLStateCache.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <vector>
+
+// Best-fit free-list allocator over [0, capacity) elements. Free blocks are kept by offset (to merge
+// a freed block with its neighbours) and by size (to find the smallest block that fits). CPU only.
+class RangeAllocator
+{
+public:
+    static constexpr uint32_t NONE = 0xFFFFFFFFu;
+
+    explicit RangeAllocator(uint32_t capacity = 0) : capacity(capacity)
+    {
+        if (capacity > 0)
+            insertFree(0, capacity);
+    }
+
+    // Offset of `count` free elements, or NONE if no single free block is large enough
+    uint32_t allocate(uint32_t count)
+    {
+        if (count == 0)
+            return 0;
+        auto fit = bySize.lower_bound(count);
+        if (fit == bySize.end())
+            return NONE;
+        uint32_t size = fit->first, offset = fit->second;
+        eraseFree(offset, size);
+        if (size > count)
+            insertFree(offset + count, size - count);
+        used += count;
+        return offset;
+    }
+
+    void free(uint32_t offset, uint32_t count)
+    {
+        if (count == 0)
+            return;
+        used -= count;
+        // Merge with the free blocks right after and right before
+        auto next = byOffset.lower_bound(offset);
+        if (next != byOffset.end() && next->first == offset + count)
+        {
+            count += next->second;
+            eraseFree(next->first, next->second);
+        }
+        next = byOffset.lower_bound(offset);
+        if (next != byOffset.begin())
+        {
+            auto prev = std::prev(next);
+            if (prev->first + prev->second == offset)
+            {
+                offset = prev->first;
+                count += prev->second;
+                eraseFree(prev->first, prev->second);
+            }
+        }
+        insertFree(offset, count);
+    }
+
+    uint32_t capacityOf() const { return capacity; }
+    uint32_t usedCount() const { return used; }
+    uint32_t freeCount() const { return capacity - used; }
+    uint32_t largestFree() const { return bySize.empty() ? 0 : bySize.rbegin()->first; }
+    size_t freeBlocks() const { return byOffset.size(); }
+
+private:
+    uint32_t capacity = 0;
+    uint32_t used = 0;
+    std::map<uint32_t, uint32_t> byOffset;          // offset -> size
+    std::multimap<uint32_t, uint32_t> bySize;       // size -> offset
+
+    void insertFree(uint32_t offset, uint32_t size)
+    {
+        byOffset[offset] = size;
+        bySize.emplace(size, offset);
+    }
+
+    void eraseFree(uint32_t offset, uint32_t size)
+    {
+        byOffset.erase(offset);
+        auto range = bySize.equal_range(size);
+        for (auto it = range.first; it != range.second; ++it)
+            if (it->second == offset)
+            {
+                bySize.erase(it);
+                break;
+            }
+    }
+};
+
+// Where one mesh's vertices and indices live in a GeometryArena. Indices are relative to the mesh's
+// own vertices, so draws pass baseVertex (glDrawElementsBaseVertex and friends).
+struct GeometrySlice {
+    int      page = -1;             // -1: nothing allocated
+    uint32_t baseVertex = 0;
+    uint32_t vertexCount = 0;
+    uint32_t firstIndex = 0;        // in elements of the page's index buffer
+    uint32_t indexCount = 0;
+};
+
+// Shared GL storage for mesh geometry of one vertex format. Geometry is sub-allocated from a few
+// large pages, each one vertex buffer + one index buffer + the VAO describing them, so loading or
+// unloading a model only writes into (or frees ranges of) buffers that already exist, and meshes on
+// the same page draw without a VAO bind between them. A new page is only created when no existing
+// one has room, which is reported since it means the reservation was too small.
+//
+// GL thread only. Pages are never deleted (the arena lives until the context goes away).
+class GeometryArena
+{
+public:
+    static constexpr uint32_t DEFAULT_PAGE_VERTICES = 1u << 21;     // 2M vertices
+    static constexpr uint32_t DEFAULT_PAGE_INDICES = 6u << 20;      // 6M indices
+
+    struct Page {
+        unsigned int VAO = 0, VBO = 0, EBO = 0;
+        RangeAllocator vertices, indices;
+        unsigned int instanceVBO = 0;   // instance buffer its user last wired into the VAO
+    };
+
+    // vertexSize is sizeof the vertex; setAttributes points the bound VAO at the bound GL_ARRAY_BUFFER
+    GeometryArena(const char *name, size_t vertexSize, void (*setAttributes)())
+        : name(name), vertexSize(vertexSize), setAttributes(setAttributes) {}
+
+    GeometryArena(const GeometryArena&) = delete;
+    GeometryArena& operator=(const GeometryArena&) = delete;
+
+    // Creates the first page up front, so loads never create GL buffers
+    void reserve(uint32_t vertexCount = DEFAULT_PAGE_VERTICES, uint32_t indexCount = DEFAULT_PAGE_INDICES)
+    {
+        if (pages.empty())
+            addPage(vertexCount, indexCount);
+    }
+
+    // Copies the geometry into the first page with room for both blocks
+    GeometrySlice allocate(const void *vertexData, size_t vertexCount, const unsigned int *indexData, size_t indexCount)
+    {
+        GeometrySlice slice;
+        slice.vertexCount = (uint32_t)vertexCount;
+        slice.indexCount = (uint32_t)indexCount;
+        for (size_t p = 0; p < pages.size() && slice.page < 0; p++)
+            place(slice, (int)p);
+        if (slice.page < 0)
+        {
+            if (!pages.empty())
+                std::cout << "GeometryArena(" << name << "): no page has room for " << vertexCount << " vertices / "
+                          << indexCount << " indices, adding page " << pages.size() << std::endl;
+            addPage(std::max(DEFAULT_PAGE_VERTICES, slice.vertexCount), std::max(DEFAULT_PAGE_INDICES, slice.indexCount));
+            place(slice, (int)pages.size() - 1);
+        }
+
+        Page &page = pages[slice.page];
+        GLStateCache &gl = GLStateCache::instance();
+        gl.bindVertexArray(page.VAO);   // the index buffer binding is VAO state
+        glBindBuffer(GL_ARRAY_BUFFER, page.VBO);
+        glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)(slice.baseVertex * vertexSize), vertexCount * vertexSize, vertexData);
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, (GLintptr)(slice.firstIndex * sizeof(unsigned int)),
+                        indexCount * sizeof(unsigned int), indexData);
+        gl.bindVertexArray(0);
+
+        allocations++;
+        liveBytes += sliceBytes(slice);
+        peakBytes = std::max(peakBytes, liveBytes);
+        return slice;
+    }
+
+    // Returns the slice's ranges to its page; the GL buffers stay
+    void free(GeometrySlice &slice)
+    {
+        if (slice.page < 0)
+            return;
+        Page &page = pages[slice.page];
+        page.vertices.free(slice.baseVertex, slice.vertexCount);
+        page.indices.free(slice.firstIndex, slice.indexCount);
+        frees++;
+        liveBytes -= sliceBytes(slice);
+        slice = GeometrySlice();
+    }
+
+    unsigned int vertexArray(const GeometrySlice &slice) const { return slice.page < 0 ? 0 : pages[slice.page].VAO; }
+    Page &pageOf(const GeometrySlice &slice) { return pages[slice.page]; }
+
+    // Share of free space not in the largest free block, worst of vertex and index storage over all
+    // pages: 0 when every page's free space is one block, near 1 when it is scattered in small holes
+    float fragmentation() const
+    {
+        float worst = 0.0f;
+        for (const Page &page : pages)
+            for (const RangeAllocator *ranges : { &page.vertices, &page.indices })
+                if (ranges->freeCount() > 0)
+                    worst = std::max(worst, 1.0f - (float)ranges->largestFree() / (float)ranges->freeCount());
+        return worst;
+    }
+
+    void printStats() const
+    {
+        size_t capacityBytes = 0;
+        for (const Page &page : pages)
+            capacityBytes += page.vertices.capacityOf() * vertexSize + page.indices.capacityOf() * sizeof(unsigned int);
+        std::cout << "GeometryArena(" << name << "): " << pages.size() << " pages, " << liveBytes / (1024 * 1024) << " of "
+                  << capacityBytes / (1024 * 1024) << " MB used (peak " << peakBytes / (1024 * 1024) << " MB), "
+                  << allocations << " allocations, " << frees << " frees, fragmentation "
+                  << (int)(fragmentation() * 100.0f + 0.5f) << "%" << std::endl;
+        for (size_t p = 0; p < pages.size(); p++)
+        {
+            const Page &page = pages[p];
+            std::cout << "  page " << p << ": " << page.vertices.usedCount() << "/" << page.vertices.capacityOf() << " vertices ("
+                      << page.vertices.freeBlocks() << " free blocks), " << page.indices.usedCount() << "/"
+                      << page.indices.capacityOf() << " indices (" << page.indices.freeBlocks() << " free blocks)" << std::endl;
+        }
+    }
+
+private:
+    const char *name;
+    size_t vertexSize;
+    void (*setAttributes)();
+    std::vector<Page> pages;
+    unsigned int allocations = 0, frees = 0;
+    size_t liveBytes = 0, peakBytes = 0;
+
+    size_t sliceBytes(const GeometrySlice &slice) const
+    {
+        return slice.vertexCount * vertexSize + slice.indexCount * sizeof(unsigned int);
+    }
+
+    // Takes both ranges from page p, or neither
+    void place(GeometrySlice &slice, int p)
+    {
+        Page &page = pages[p];
+        uint32_t baseVertex = page.vertices.allocate(slice.vertexCount);
+        if (baseVertex == RangeAllocator::NONE)
+            return;
+        uint32_t firstIndex = page.indices.allocate(slice.indexCount);
+        if (firstIndex == RangeAllocator::NONE)
+        {
+            page.vertices.free(baseVertex, slice.vertexCount);
+            return;
+        }
+        slice.page = p;
+        slice.baseVertex = baseVertex;
+        slice.firstIndex = firstIndex;
+    }
+
+    void addPage(uint32_t vertexCount, uint32_t indexCount)
+    {
+        pages.emplace_back();
+        Page &page = pages.back();
+        page.vertices = RangeAllocator(vertexCount);
+        page.indices = RangeAllocator(indexCount);
+        glGenVertexArrays(1, &page.VAO);
+        glGenBuffers(1, &page.VBO);
+        glGenBuffers(1, &page.EBO);
+
+        GLStateCache::instance().bindVertexArray(page.VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, page.VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertexCount * vertexSize, NULL, GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, page.EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(unsigned int), NULL, GL_STATIC_DRAW);
+        setAttributes();
+        GLStateCache::instance().bindVertexArray(0);
+    }
+};
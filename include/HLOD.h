@@ -0,0 +1,372 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "Frustum.h"
+#include "GLStateCache.h"
+#include "MeshSimplifier.h"
+#include "Model.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// Hierarchical level of detail for a static model (the city). Its meshes are grouped into spatial
+// clusters; each cluster is merged into a single simplified proxy mesh, textured from one shared atlas
+// baked from the small mips of the source textures. Far away, a cluster draws its proxy (one draw)
+// instead of its meshes.
+//
+// Building happens in three steps, like a model load:
+//   CaptureTiles() - GL thread: reads the source textures back at HLOD_TILE_SIZE
+//   Build()        - any thread: clustering, merging, simplification, atlas packing
+//   upload()       - GL thread: proxy buffers and the atlas texture
+const int   HLOD_MAX_CLUSTERS = 16;         // the model is split in halves until it has this many clusters
+const int   HLOD_TILE_SIZE = 32;            // atlas pixels per source texture (square)
+const float HLOD_REDUCTION = 16.0f;         // a proxy aims at 1/HLOD_REDUCTION of its cluster's triangles
+const float HLOD_MIN_DISTANCE = 1500.0f;    // world units; the baked texture is too coarse to show any closer
+
+// One source texture scaled down to HLOD_TILE_SIZE^2 RGBA, plus its average color
+struct HLODTile {
+    unsigned int texture = 0;
+    std::vector<unsigned char> pixels;
+    unsigned char average[4] = { 255, 255, 255, 255 };
+};
+
+struct HLODCluster {
+    std::vector<uint32_t> meshes;   // indices into the model's meshes
+    glm::vec3 minAABB, maxAABB;     // model space, around every member mesh
+    float error = 0.0f;             // model units the proxy's surface may be off by
+    float switchDistance = 0.0f;    // the proxy is drawn when the cluster is at least this far (world units)
+};
+
+// CPU result of Build(), turned into GL objects by HLOD::upload
+struct HLODData {
+    std::vector<HLODCluster> clusters;
+    std::vector<std::vector<Vertex>> vertices;          // per cluster, model space, UVs into the atlas
+    std::vector<std::vector<unsigned int>> indices;
+    std::vector<unsigned char> atlas;                   // atlasSize^2 RGBA
+    int atlasSize = 0;
+};
+
+class HLOD
+{
+public:
+    std::vector<HLODCluster> clusters;
+    std::vector<Mesh> proxies;          // proxies[i] stands in for clusters[i]
+    std::vector<int> clusterOf;         // cluster of each of the model's meshes
+    unsigned int atlas = 0;
+    float scale = 1.0f;                 // of the model's (uniformly scaled) world transform
+
+    HLOD() = default;
+    HLOD(const HLOD&) = delete;
+    HLOD& operator=(const HLOD&) = delete;
+    ~HLOD() { release(); }
+
+    bool ready() const { return !proxies.empty(); }
+
+    // GL thread. The diffuse texture of every mesh, read back from the mip level closest to
+    // HLOD_TILE_SIZE and resampled to exactly that size.
+    static std::vector<HLODTile> CaptureTiles(const Model &model)
+    {
+        std::vector<HLODTile> tiles;
+        GLStateCache &gl = GLStateCache::instance();
+        for (const Mesh &mesh : model.meshes)
+        {
+            unsigned int texture = mesh.diffuseTexture();
+            if (texture == 0 || std::any_of(tiles.begin(), tiles.end(), [&](const HLODTile &t) { return t.texture == texture; }))
+                continue;
+
+            gl.bindTexture2D(0, texture);
+            int width = 0, height = 0, level = 0;
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+            while (std::max(width, height) > HLOD_TILE_SIZE && std::min(width, height) > 1)
+            {
+                width = std::max(1, width / 2);
+                height = std::max(1, height / 2);
+                level++;
+            }
+            std::vector<unsigned char> mip((size_t)width * height * 4);
+            glPixelStorei(GL_PACK_ALIGNMENT, 1);
+            glGetTexImage(GL_TEXTURE_2D, level, GL_RGBA, GL_UNSIGNED_BYTE, mip.data());
+
+            HLODTile tile;
+            tile.texture = texture;
+            tile.pixels.resize(HLOD_TILE_SIZE * HLOD_TILE_SIZE * 4);
+            unsigned long long sum[4] = {};
+            for (int y = 0; y < HLOD_TILE_SIZE; y++)
+            {
+                for (int x = 0; x < HLOD_TILE_SIZE; x++)
+                {
+                    const unsigned char *source = &mip[((size_t)(y * height / HLOD_TILE_SIZE) * width + x * width / HLOD_TILE_SIZE) * 4];
+                    for (int c = 0; c < 4; c++)
+                    {
+                        tile.pixels[(y * HLOD_TILE_SIZE + x) * 4 + c] = source[c];
+                        sum[c] += source[c];
+                    }
+                }
+            }
+            for (int c = 0; c < 4; c++)
+                tile.average[c] = (unsigned char)(sum[c] / (HLOD_TILE_SIZE * HLOD_TILE_SIZE));
+            tiles.push_back(std::move(tile));
+        }
+        return tiles;
+    }
+
+    // Any thread (only reads the model's CPU-side vertex/index data and tiles).
+    static HLODData Build(const Model &model, const std::vector<HLODTile> &tiles)
+    {
+        HLODData data;
+        if (model.meshes.empty())
+            return data;
+        buildClusters(model, data.clusters);
+
+        // Atlas: a white tile for untextured meshes, then each texture twice: as is, and as its average
+        // color, for meshes whose UVs repeat the texture (a repeating texture can't live in an atlas tile,
+        // and from far away it blends to its average anyway)
+        int tileCount = 1 + 2 * (int)tiles.size();
+        int columns = (int)std::ceil(std::sqrt((float)tileCount));
+        data.atlasSize = columns * HLOD_TILE_SIZE;
+        data.atlas.assign((size_t)data.atlasSize * data.atlasSize * 4, 255);
+        std::unordered_map<unsigned int, int> tileOf;   // texture -> index of its image tile
+        for (size_t t = 0; t < tiles.size(); t++)
+        {
+            int image = 1 + 2 * (int)t;
+            tileOf[tiles[t].texture] = image;
+            for (int y = 0; y < HLOD_TILE_SIZE; y++)
+            {
+                for (int x = 0; x < HLOD_TILE_SIZE; x++)
+                {
+                    for (int c = 0; c < 4; c++)
+                    {
+                        atlasPixel(data, image, x, y)[c] = tiles[t].pixels[(y * HLOD_TILE_SIZE + x) * 4 + c];
+                        atlasPixel(data, image + 1, x, y)[c] = tiles[t].average[c];
+                    }
+                }
+            }
+        }
+
+        // One job per cluster
+        data.vertices.resize(data.clusters.size());
+        data.indices.resize(data.clusters.size());
+        JobSystem::instance().parallelFor((uint32_t)data.clusters.size(), 1, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t c = begin; c < end; c++)
+            {
+                HLODCluster &cluster = data.clusters[c];
+
+                // Merge the members' full-detail triangles, with their UVs moved into the atlas
+                std::vector<Vertex> merged;
+                std::vector<unsigned int> mergedIndices;
+                for (uint32_t m : cluster.meshes)
+                {
+                    const Mesh &mesh = model.meshes[m];
+                    const Vertex *vertices = mesh.vertexData();
+                    size_t vertexCount = mesh.vertexCount();
+                    const unsigned int *indices = mesh.indexData() + mesh.lods[0].firstIndex;
+
+                    bool repeats = false;
+                    for (size_t v = 0; v < vertexCount; v++)
+                    {
+                        const glm::vec2 &uv = vertices[v].TexCoords;
+                        repeats |= uv.x < -0.01f || uv.x > 1.01f || uv.y < -0.01f || uv.y > 1.01f;
+                    }
+                    auto found = tileOf.find(mesh.diffuseTexture());
+                    int tile = found == tileOf.end() ? 0 : found->second + (repeats ? 1 : 0);
+
+                    unsigned int base = (unsigned int)merged.size();
+                    for (size_t v = 0; v < vertexCount; v++)
+                    {
+                        Vertex vertex = vertices[v];
+                        vertex.TexCoords = atlasUV(data, tile, tile == 0 || repeats ? glm::vec2(0.5f) : vertex.TexCoords);
+                        merged.push_back(vertex);
+                    }
+                    for (uint32_t i = 0; i + 2 < mesh.lods[0].indexCount; i += 3)
+                        if (indices[i] < vertexCount && indices[i + 1] < vertexCount && indices[i + 2] < vertexCount)
+                            mergedIndices.insert(mergedIndices.end(), { base + indices[i], base + indices[i + 1], base + indices[i + 2] });
+                }
+
+                uint32_t target = (uint32_t)(mergedIndices.size() / 3 / HLOD_REDUCTION);
+                std::vector<unsigned int> proxy = MeshSimplifier::Simplify(merged, mergedIndices, target, cluster.error);
+
+                // Keep only the vertices the proxy still uses
+                std::vector<unsigned int> remap(merged.size(), UINT32_MAX);
+                for (unsigned int &index : proxy)
+                {
+                    if (remap[index] == UINT32_MAX)
+                    {
+                        remap[index] = (unsigned int)data.vertices[c].size();
+                        data.vertices[c].push_back(merged[index]);
+                    }
+                    index = remap[index];
+                }
+                data.indices[c] = std::move(proxy);
+            }
+        });
+        return data;
+    }
+
+    // GL thread. The model is drawn scaled by modelScale; pixelsPerUnitAtOne is how many screen pixels
+    // a world unit covers one unit away from the camera. Each cluster switches to its proxy where the
+    // proxy's error shrinks to LOD_PIXEL_ERROR pixels, but never closer than HLOD_MIN_DISTANCE.
+    void upload(HLODData &data, const Model &model, float modelScale, float pixelsPerUnitAtOne)
+    {
+        release();
+        clusters = std::move(data.clusters);
+        scale = modelScale;
+
+        GLStateCache &gl = GLStateCache::instance();
+        glGenTextures(1, &atlas);
+        gl.bindTexture2D(0, atlas);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, data.atlasSize, data.atlasSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, data.atlas.data());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 3);   // tiles stay apart down to 4x4
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        Texture texture;
+        texture.id = atlas;
+        texture.type = "texture_diffuse";
+        texture.path = "hlod_atlas";
+        proxies.reserve(clusters.size());
+        size_t triangles = 0, sourceTriangles = 0;
+        for (size_t c = 0; c < clusters.size(); c++)
+        {
+            HLODCluster &cluster = clusters[c];
+            cluster.switchDistance = std::max(HLOD_MIN_DISTANCE, cluster.error * scale * pixelsPerUnitAtOne / LOD_PIXEL_ERROR);
+            triangles += data.indices[c].size() / 3;
+            for (uint32_t m : cluster.meshes)
+                sourceTriangles += model.meshes[m].lods[0].indexCount / 3;
+            proxies.emplace_back(std::move(data.vertices[c]), std::move(data.indices[c]), std::vector<Texture>{ texture }, "hlod_proxy");
+            proxies.back().minAABB = cluster.minAABB;
+            proxies.back().maxAABB = cluster.maxAABB;
+        }
+
+        clusterOf.assign(model.meshes.size(), -1);
+        for (size_t c = 0; c < clusters.size(); c++)
+            for (uint32_t m : clusters[c].meshes)
+                clusterOf[m] = (int)c;
+        showingProxy.assign(clusters.size(), 0);
+        std::cout << "HLOD: " << clusters.size() << " clusters, " << sourceTriangles << " -> " << triangles
+                  << " triangles, " << data.atlasSize << "x" << data.atlasSize << " atlas" << std::endl;
+    }
+
+    // Whether cluster c should draw its proxy, `distance` world units away from the camera. Once a
+    // proxy is shown it stays until the cluster comes LOD_HYSTERESIS closer than switchDistance.
+    bool useProxy(int c, float distance)
+    {
+        float threshold = clusters[c].switchDistance * (showingProxy[c] ? 1.0f - LOD_HYSTERESIS : 1.0f);
+        showingProxy[c] = distance >= threshold;
+        return showingProxy[c] != 0;
+    }
+
+    // Whether cluster c's proxy can stand in for its meshes in a shadow map with texelSize world units per texel
+    bool useProxyInShadow(int c, float texelSize) const
+    {
+        return clusters[c].error * scale <= texelSize;
+    }
+
+    void release()
+    {
+        for (Mesh &proxy : proxies)
+            proxy.release();
+        proxies.clear();
+        if (atlas)
+        {
+            GLStateCache::instance().forgetTexture(atlas);
+            glDeleteTextures(1, &atlas);
+            atlas = 0;
+        }
+    }
+
+private:
+    std::vector<unsigned char> showingProxy;
+
+    // Splits the meshes in halves at the median of their centers along the longest axis, always
+    // splitting the cluster with the most triangles, until there are HLOD_MAX_CLUSTERS
+    static void buildClusters(const Model &model, std::vector<HLODCluster> &clusters)
+    {
+        std::vector<glm::vec3> centers(model.meshes.size());
+        HLODCluster all;
+        for (uint32_t m = 0; m < model.meshes.size(); m++)
+        {
+            centers[m] = 0.5f * (model.meshes[m].minAABB + model.meshes[m].maxAABB);
+            all.meshes.push_back(m);
+        }
+        clusters.clear();
+        clusters.push_back(all);
+
+        auto triangles = [&](const HLODCluster &cluster) {
+            size_t count = 0;
+            for (uint32_t m : cluster.meshes)
+                count += model.meshes[m].lods[0].indexCount / 3;
+            return count;
+        };
+        while ((int)clusters.size() < HLOD_MAX_CLUSTERS)
+        {
+            int largest = -1;
+            size_t largestTriangles = 0;
+            for (size_t c = 0; c < clusters.size(); c++)
+            {
+                size_t count = triangles(clusters[c]);
+                if (clusters[c].meshes.size() > 1 && count > largestTriangles)
+                {
+                    largest = (int)c;
+                    largestTriangles = count;
+                }
+            }
+            if (largest < 0)
+                break;
+
+            std::vector<uint32_t> &meshes = clusters[largest].meshes;
+            glm::vec3 lo = centers[meshes[0]], hi = lo;
+            for (uint32_t m : meshes)
+            {
+                lo = glm::min(lo, centers[m]);
+                hi = glm::max(hi, centers[m]);
+            }
+            glm::vec3 size = hi - lo;
+            int axis = size.x >= size.y && size.x >= size.z ? 0 : (size.y >= size.z ? 1 : 2);
+            size_t half = meshes.size() / 2;
+            std::nth_element(meshes.begin(), meshes.begin() + half, meshes.end(),
+                             [&](uint32_t a, uint32_t b) { return centers[a][axis] < centers[b][axis]; });
+            HLODCluster upper;
+            upper.meshes.assign(meshes.begin() + half, meshes.end());
+            meshes.resize(half);
+            clusters.push_back(upper);
+        }
+
+        for (HLODCluster &cluster : clusters)
+        {
+            cluster.minAABB = model.meshes[cluster.meshes[0]].minAABB;
+            cluster.maxAABB = model.meshes[cluster.meshes[0]].maxAABB;
+            for (uint32_t m : cluster.meshes)
+            {
+                cluster.minAABB = glm::min(cluster.minAABB, model.meshes[m].minAABB);
+                cluster.maxAABB = glm::max(cluster.maxAABB, model.meshes[m].maxAABB);
+            }
+        }
+    }
+
+    static unsigned char *atlasPixel(HLODData &data, int tile, int x, int y)
+    {
+        int columns = data.atlasSize / HLOD_TILE_SIZE;
+        int px = (tile % columns) * HLOD_TILE_SIZE + x;
+        int py = (tile / columns) * HLOD_TILE_SIZE + y;
+        return &data.atlas[((size_t)py * data.atlasSize + px) * 4];
+    }
+
+    // uv (0..1 over the source texture) inside tile, kept half a texel away from its edges
+    static glm::vec2 atlasUV(const HLODData &data, int tile, glm::vec2 uv)
+    {
+        int columns = data.atlasSize / HLOD_TILE_SIZE;
+        uv = glm::clamp(uv, glm::vec2(0.0f), glm::vec2(1.0f));
+        glm::vec2 origin((float)(tile % columns * HLOD_TILE_SIZE), (float)(tile / columns * HLOD_TILE_SIZE));
+        return (origin + glm::vec2(0.5f) + uv * (float)(HLOD_TILE_SIZE - 1)) / (float)data.atlasSize;
+    }
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// 64-bit FNV-1a. Used to key cached/shared assets by their content instead of their path.
+const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ull;
+const uint64_t FNV_PRIME        = 1099511628211ull;
+
+inline uint64_t HashBytes(const void *data, size_t size, uint64_t seed = FNV_OFFSET_BASIS)
+{
+    const unsigned char *bytes = static_cast<const unsigned char*>(data);
+    uint64_t hash = seed;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+// Hashes a whole file in chunks. Returns false if the file can't be opened.
+inline bool HashFile(const std::string &path, uint64_t &outHash, uint64_t &outSize)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+
+    std::vector<char> chunk(1 << 20);
+    uint64_t hash = FNV_OFFSET_BASIS;
+    uint64_t size = 0;
+    while (file)
+    {
+        file.read(chunk.data(), (std::streamsize)chunk.size());
+        std::streamsize got = file.gcount();
+        if (got <= 0)
+            break;
+        hash = HashBytes(chunk.data(), (size_t)got, hash);
+        size += (uint64_t)got;
+    }
+    outHash = hash;
+    outSize = size;
+    return true;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// Values for instanced.vs's instanceMode uniform
+enum InstanceMode {
+    INSTANCE_AIRCRAFT   = 0,
+    INSTANCE_PROJECTILE = 1,
+    INSTANCE_EXPLOSION  = 2
+};
+
+// Per-instance attributes for instanced.vs (locations 3 and 4, divisor 1).
+// What `params` means depends on the shader's instanceMode:
+//   aircraft:   x = yaw (radians), y = propeller angle (degrees)
+//   projectile: xyz = normalized flight direction
+//   explosion:  unused
+struct InstanceData {
+    glm::vec4 posScale;     // xyz = world position, w = uniform scale
+    glm::vec4 params;
+};
+
+// Streaming GL buffer holding one frame's worth of InstanceData.
+class InstanceBuffer
+{
+public:
+    unsigned int VBO = 0;
+    GLsizei count = 0;
+
+    void upload(const std::vector<InstanceData> &instances)
+    {
+        if (VBO == 0)
+            glGenBuffers(1, &VBO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        size_t bytes = instances.size() * sizeof(InstanceData);
+        if (bytes > capacity)
+            capacity = bytes * 2;
+        glBufferData(GL_ARRAY_BUFFER, capacity, nullptr, GL_STREAM_DRAW); // orphan last frame's storage
+        if (bytes > 0)
+            glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, instances.data());
+        count = (GLsizei)instances.size();
+    }
+
+private:
+    size_t capacity = 0;
+};
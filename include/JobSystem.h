@@ -0,0 +1,475 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Counts unfinished jobs. JobSystem::wait blocks on one; jobs queued with runAfter start when it
+// reaches zero. Must outlive the jobs that refer to it.
+class JobCounter
+{
+public:
+    JobCounter() = default;
+    JobCounter(const JobCounter&) = delete;
+    JobCounter& operator=(const JobCounter&) = delete;
+
+    bool done() const { return pending.load(std::memory_order_acquire) == 0; }
+
+private:
+    friend class JobSystem;
+    struct Continuation {
+        std::function<void()> fn;
+        JobCounter *counter;
+    };
+    std::atomic<int> pending{0};
+    std::atomic<int> queued{0};         // its jobs sitting in a queue (a waiter could run them)
+    std::mutex mutex;
+    std::condition_variable wake;       // pending reached zero or one of its jobs was queued
+    std::vector<Continuation> continuations;
+};
+
+// Work-stealing job system shared by loading, simulation and culling.
+// Every worker has its own deque: it pushes and pops at the back (newest first, still warm in
+// cache) while idle workers steal from the front. Jobs queued from other threads (the GL and
+// simulation threads) go through a shared injection queue. A thread waiting on a counter helps
+// with that counter's jobs only, so nested parallelFor calls can't deadlock the pool, and neither
+// a frame, a fixed step nor an outer job can end up stuck behind an unrelated load or bake.
+// Once none of its jobs is left in a queue it sleeps until the counter is done.
+// Workers never touch GL: runOnMainThread queues work for the context thread instead.
+class JobSystem
+{
+public:
+    // Per-frame scheduler trace (see endFrame)
+    struct FrameTrace {
+        double frameMs = 0.0;
+        std::vector<float> workerBusy;      // per worker, fraction of the frame spent running jobs
+        double helperMs = 0.0;              // jobs run by non-workers while they waited (their own counter's)
+        unsigned int jobs = 0;
+        unsigned int steals = 0;
+
+        float utilization() const
+        {
+            float sum = 0.0f;
+            for (float busy : workerBusy)
+                sum += busy;
+            return workerBusy.empty() ? 0.0f : sum / workerBusy.size();
+        }
+    };
+
+    static JobSystem &instance()
+    {
+        static JobSystem system;
+        return system;
+    }
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    unsigned int workerCount() const { return (unsigned int)workers.size(); }
+
+    // Queues fn. counter, if given, is incremented now and decremented once fn has run.
+    void run(std::function<void()> fn, JobCounter *counter = nullptr)
+    {
+        if (counter)
+            counter->pending.fetch_add(1, std::memory_order_relaxed);
+        push(Job{ std::move(fn), counter });
+    }
+
+    // Like run, but fn is only queued once `after` has reached zero
+    void runAfter(JobCounter &after, std::function<void()> fn, JobCounter *counter = nullptr)
+    {
+        if (counter)
+            counter->pending.fetch_add(1, std::memory_order_relaxed);
+        {
+            std::lock_guard<std::mutex> lock(after.mutex);
+            if (!after.done())
+            {
+                after.continuations.push_back(JobCounter::Continuation{ std::move(fn), counter });
+                return;
+            }
+        }
+        push(Job{ std::move(fn), counter });
+    }
+
+    // Blocks until counter reaches zero, running its queued jobs meanwhile
+    void wait(JobCounter &counter)
+    {
+        int spins = 0;
+        while (!counter.done())
+        {
+            Job job;
+            if (findJobOf(&counter, job))
+            {
+                execute(job);
+                spins = 0;
+            }
+            else if (++spins < WAIT_SPINS)
+            {
+                std::this_thread::yield();      // the last jobs are usually only a moment from done
+            }
+            else
+            {
+                std::unique_lock<std::mutex> lock(counter.mutex);
+                counter.wake.wait(lock, [&counter] {
+                    return counter.done() || counter.queued.load(std::memory_order_acquire) > 0;
+                });
+                spins = 0;
+            }
+        }
+        // The last job may still be unlocking the counter; once we get the lock it can be destroyed
+        std::lock_guard<std::mutex> lock(counter.mutex);
+    }
+
+    // Queues fn and returns a future for its result
+    template <typename F>
+    auto async(F fn) -> std::future<decltype(fn())>
+    {
+        typedef decltype(fn()) Result;
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::move(fn));
+        std::future<Result> result = task->get_future();
+        run([task] { (*task)(); });
+        return result;
+    }
+
+    // Calls body(begin, end) over [0, count) in chunks of `grain` (the last may be shorter), spread
+    // over the workers, and returns when all are done. The calling thread takes a chunk too.
+    // Small ranges run inline.
+    template <typename Body>
+    void parallelFor(uint32_t count, uint32_t grain, const Body &body)
+    {
+        grain = std::max<uint32_t>(grain, 1);
+        if (count <= grain || workers.empty())
+        {
+            if (count > 0)
+                body(0u, count);
+            return;
+        }
+        JobCounter counter;
+        for (uint32_t begin = grain; begin < count; begin += grain)
+        {
+            uint32_t end = std::min(begin + grain, count);
+            run([&body, begin, end] { body(begin, end); }, &counter);
+        }
+        body(0u, grain);
+        wait(counter);
+    }
+
+    // --- Main (GL context) thread queue ---
+
+    void runOnMainThread(std::function<void()> fn)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mainMutex);
+            mainJobs.push_back(std::move(fn));
+        }
+        mainWake.notify_all();
+    }
+
+    // Main thread only. Runs queued main-thread jobs until budgetMs has been spent (at least one
+    // if any is waiting). Returns how many ran.
+    int runMainThreadJobs(double budgetMs = 1.0e9)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        int ran = 0;
+        for (;;)
+        {
+            std::function<void()> fn;
+            {
+                std::lock_guard<std::mutex> lock(mainMutex);
+                if (mainJobs.empty())
+                    break;
+                fn = std::move(mainJobs.front());
+                mainJobs.pop_front();
+            }
+            fn();
+            ran++;
+            double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            if (elapsedMs >= budgetMs)
+                break;
+        }
+        return ran;
+    }
+
+    // Main thread only. Blocks until a main-thread job is queued.
+    void waitForMainThreadJob()
+    {
+        std::unique_lock<std::mutex> lock(mainMutex);
+        mainWake.wait(lock, [this] { return !mainJobs.empty(); });
+    }
+
+    // --- Trace ---
+
+    // Closes the current frame's trace; call once per rendered frame
+    void endFrame()
+    {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        double frameNs = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(now - frameStart).count();
+        frameStart = now;
+
+        trace.frameMs = frameNs / 1.0e6;
+        trace.workerBusy.resize(workers.size());
+        trace.jobs = 0;
+        trace.steals = 0;
+        for (size_t i = 0; i < workers.size(); i++)
+        {
+            Worker &worker = *workers[i];
+            double busyNs = (double)worker.busyNs.exchange(0, std::memory_order_relaxed);
+            trace.workerBusy[i] = frameNs > 0.0 ? (float)std::min(1.0, busyNs / frameNs) : 0.0f;
+            trace.jobs += worker.jobsRun.exchange(0, std::memory_order_relaxed);
+            trace.steals += worker.steals.exchange(0, std::memory_order_relaxed);
+        }
+        trace.helperMs = (double)helperBusyNs.exchange(0, std::memory_order_relaxed) / 1.0e6;
+        trace.jobs += helperJobs.exchange(0, std::memory_order_relaxed);
+    }
+
+    const FrameTrace &lastFrame() const { return trace; }
+
+    // e.g. "37% [12 80 45 11]": average and per-worker busy percentages of the last frame
+    std::string traceSummary() const
+    {
+        std::string summary = std::to_string((int)(trace.utilization() * 100.0f + 0.5f)) + "% [";
+        for (size_t i = 0; i < trace.workerBusy.size(); i++)
+            summary += (i ? " " : "") + std::to_string((int)(trace.workerBusy[i] * 100.0f + 0.5f));
+        return summary + "]";
+    }
+
+private:
+    static const int WAIT_SPINS = 64;   // yields before a waiting thread sleeps
+
+    struct Job {
+        std::function<void()> fn;
+        JobCounter *counter = nullptr;
+    };
+
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Job> jobs;           // owner: back, thieves: front
+        std::thread thread;
+        std::atomic<uint64_t> busyNs{0};
+        std::atomic<unsigned int> jobsRun{0};
+        std::atomic<unsigned int> steals{0};
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::mutex injectMutex;
+    std::deque<Job> injected;           // jobs queued from non-worker threads
+    std::atomic<int> queued{0};         // jobs sitting in any queue
+    std::mutex sleepMutex;
+    std::condition_variable sleepWake;
+    bool stopping = false;
+
+    std::mutex mainMutex;
+    std::condition_variable mainWake;
+    std::deque<std::function<void()>> mainJobs;
+
+    std::atomic<uint64_t> helperBusyNs{0};
+    std::atomic<unsigned int> helperJobs{0};
+    std::chrono::steady_clock::time_point frameStart = std::chrono::steady_clock::now();
+    FrameTrace trace;
+
+    // Index of the worker running on this thread, -1 on other threads
+    static int &currentWorker()
+    {
+        static thread_local int index = -1;
+        return index;
+    }
+
+    // One worker per hardware thread, leaving one for the GL thread
+    JobSystem()
+    {
+        unsigned int hw = std::thread::hardware_concurrency();
+        unsigned int count = hw > 1 ? hw - 1 : 1;
+        for (unsigned int i = 0; i < count; i++)
+            workers.push_back(std::unique_ptr<Worker>(new Worker()));
+        for (unsigned int i = 0; i < count; i++)
+            workers[i]->thread = std::thread([this, i] { workerLoop((int)i); });
+    }
+
+    ~JobSystem()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        sleepWake.notify_all();
+        for (std::unique_ptr<Worker> &worker : workers)
+            worker->thread.join();
+    }
+
+    void push(Job job)
+    {
+        if (JobCounter *counter = job.counter)
+        {
+            // Wake a thread sleeping on the counter so it can help. Done before queueing: once queued,
+            // the job may finish and the waiter return (destroying the counter) before we get here.
+            std::lock_guard<std::mutex> lock(counter->mutex);
+            counter->queued.fetch_add(1, std::memory_order_release);
+            counter->wake.notify_all();
+        }
+        queued.fetch_add(1, std::memory_order_release);
+        int self = currentWorker();
+        if (self >= 0)
+        {
+            std::lock_guard<std::mutex> lock(workers[self]->mutex);
+            workers[self]->jobs.push_back(std::move(job));
+        }
+        else
+        {
+            std::lock_guard<std::mutex> lock(injectMutex);
+            injected.push_back(std::move(job));
+        }
+        // Taking the lock orders this against a worker that's about to sleep, so the wake isn't lost
+        { std::lock_guard<std::mutex> lock(sleepMutex); }
+        sleepWake.notify_one();
+    }
+
+    // Bookkeeping for a job just taken out of a queue
+    void took(const Job &job)
+    {
+        queued.fetch_sub(1, std::memory_order_relaxed);
+        if (job.counter)
+            job.counter->queued.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    bool findJob(Job &job)
+    {
+        if (queued.load(std::memory_order_acquire) <= 0)
+            return false;
+        int self = currentWorker();
+        if (self >= 0)
+        {
+            Worker &own = *workers[self];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.jobs.empty())
+            {
+                job = std::move(own.jobs.back());
+                own.jobs.pop_back();
+                took(job);
+                return true;
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(injectMutex);
+            if (!injected.empty())
+            {
+                job = std::move(injected.front());
+                injected.pop_front();
+                took(job);
+                return true;
+            }
+        }
+        // Steal the oldest job of another worker, starting with the next one along
+        size_t count = workers.size();
+        size_t first = self >= 0 ? (size_t)self + 1 : 0;
+        for (size_t n = 0; n < count; n++)
+        {
+            size_t victim = (first + n) % count;
+            if ((int)victim == self)
+                continue;
+            Worker &other = *workers[victim];
+            std::lock_guard<std::mutex> lock(other.mutex);
+            if (!other.jobs.empty())
+            {
+                job = std::move(other.jobs.front());
+                other.jobs.pop_front();
+                took(job);
+                if (self >= 0)
+                    workers[self]->steals.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Takes a queued job that decrements counter, wherever it is queued
+    bool findJobOf(JobCounter *counter, Job &job)
+    {
+        if (queued.load(std::memory_order_acquire) <= 0)
+            return false;
+        if (takeJobOf(counter, injectMutex, injected, job))
+            return true;
+        for (std::unique_ptr<Worker> &worker : workers)
+            if (takeJobOf(counter, worker->mutex, worker->jobs, job))
+                return true;
+        return false;
+    }
+
+    bool takeJobOf(JobCounter *counter, std::mutex &mutex, std::deque<Job> &jobs, Job &job)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (std::deque<Job>::iterator it = jobs.begin(); it != jobs.end(); ++it)
+        {
+            if (it->counter != counter)
+                continue;
+            job = std::move(*it);
+            jobs.erase(it);
+            took(job);
+            return true;
+        }
+        return false;
+    }
+
+    void execute(Job &job)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        job.fn();
+        uint64_t ns = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        int self = currentWorker();
+        if (self >= 0)
+        {
+            workers[self]->busyNs.fetch_add(ns, std::memory_order_relaxed);
+            workers[self]->jobsRun.fetch_add(1, std::memory_order_relaxed);
+        }
+        else
+        {
+            helperBusyNs.fetch_add(ns, std::memory_order_relaxed);
+            helperJobs.fetch_add(1, std::memory_order_relaxed);
+        }
+        finish(job.counter);
+    }
+
+    void finish(JobCounter *counter)
+    {
+        if (!counter)
+            return;
+        // Decremented under the lock so runAfter can't add a continuation after they've been taken
+        std::vector<JobCounter::Continuation> ready;
+        {
+            std::lock_guard<std::mutex> lock(counter->mutex);
+            if (counter->pending.fetch_sub(1, std::memory_order_acq_rel) != 1)
+                return;
+            ready.swap(counter->continuations);
+            counter->wake.notify_all();     // under the lock, so a waiter can't destroy the counter first
+        }
+        for (JobCounter::Continuation &next : ready)
+            push(Job{ std::move(next.fn), next.counter });
+    }
+
+    void workerLoop(int index)
+    {
+        currentWorker() = index;
+        for (;;)
+        {
+            Job job;
+            if (findJob(job))
+            {
+                execute(job);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            sleepWake.wait(lock, [this] { return stopping || queued.load(std::memory_order_acquire) > 0; });
+            if (stopping)
+                return;
+        }
+    }
+};
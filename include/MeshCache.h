@@ -0,0 +1,359 @@
+#pragma once
+
+// Offline binary mesh cache (.meshbin).
+//
+// A .meshbin sits next to its source asset (e.g. "bullet.glb.meshbin") and holds the
+// already-processed output of Model::processMesh: vertex/index blocks (every LOD's indices,
+// one after the other), mesh names, per-mesh AABBs and LOD ranges, texture references and
+// the bytes of any embedded textures.
+// The file is memory mapped and the blocks are handed to GL straight from the
+// mapping, so a warm start never touches Assimp.
+//
+// Layout (all offsets are from the start of the file, blocks are 16-byte aligned):
+//   MeshCacheHeader
+//   MeshCacheMeshRecord[meshCount]
+//   MeshCacheTextureRef[textureRefCount]
+//   MeshCacheEmbeddedTexture[embeddedTextureCount]
+//   string table, vertex blocks, index blocks, embedded texture bytes
+
+#include "Hash.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <iostream>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Bump whenever the layout below or the processing in Model::processMesh changes.
+const uint32_t MESH_CACHE_VERSION = 2;
+const char     MESH_CACHE_MAGIC[8] = { 'M', 'E', 'S', 'H', 'B', 'I', 'N', '\0' };
+const uint32_t MESH_CACHE_ENDIAN_TAG = 0x01020304u;
+const uint32_t MESH_CACHE_MAX_LODS = 4;
+
+struct MeshCacheHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t endianTag;
+    uint32_t vertexStride;      // sizeof(Vertex) at bake time
+    uint32_t meshCount;
+    uint32_t textureRefCount;
+    uint32_t embeddedTextureCount;
+    uint64_t sourceHash;        // FNV-1a of the source asset
+    uint64_t sourceSize;
+    uint64_t meshTableOffset;
+    uint64_t textureRefOffset;
+    uint64_t embeddedTableOffset;
+    uint64_t fileSize;
+};
+
+struct MeshCacheLod {
+    uint32_t firstIndex;        // into the mesh's index block
+    uint32_t indexCount;
+    float    error;
+};
+
+struct MeshCacheMeshRecord {
+    uint64_t vertexOffset;
+    uint64_t indexOffset;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    float    minAABB[3];
+    float    maxAABB[3];
+    uint32_t nameOffset;        // into the string table (absolute file offset)
+    uint32_t nameLength;
+    uint32_t firstTextureRef;
+    uint32_t textureRefCount;
+    uint32_t lodCount;
+    MeshCacheLod lods[MESH_CACHE_MAX_LODS];
+};
+
+struct MeshCacheTextureRef {
+    uint32_t pathOffset;
+    uint32_t pathLength;
+    uint32_t typeOffset;
+    uint32_t typeLength;
+};
+
+struct MeshCacheEmbeddedTexture {
+    uint64_t dataOffset;
+    uint64_t size;
+};
+
+// Read-only memory mapping of a whole file. Unmapped when the last owner lets go.
+class MappedFile
+{
+public:
+    const unsigned char *data = nullptr;
+    size_t size = 0;
+
+    static std::shared_ptr<MappedFile> open(const std::string &path)
+    {
+        std::shared_ptr<MappedFile> file(new MappedFile());
+#ifdef _WIN32
+        file->fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file->fileHandle == INVALID_HANDLE_VALUE)
+            return nullptr;
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file->fileHandle, &fileSize) || fileSize.QuadPart == 0)
+            return nullptr;
+        file->mapping = CreateFileMappingA(file->fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (!file->mapping)
+            return nullptr;
+        file->data = static_cast<const unsigned char*>(MapViewOfFile(file->mapping, FILE_MAP_READ, 0, 0, 0));
+        if (!file->data)
+            return nullptr;
+        file->size = (size_t)fileSize.QuadPart;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return nullptr;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0)
+        {
+            ::close(fd);
+            return nullptr;
+        }
+        void *mapped = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd); // the mapping stays valid after the descriptor is closed
+        if (mapped == MAP_FAILED)
+            return nullptr;
+        file->data = static_cast<const unsigned char*>(mapped);
+        file->size = (size_t)st.st_size;
+#endif
+        return file;
+    }
+
+    ~MappedFile()
+    {
+#ifdef _WIN32
+        if (data) UnmapViewOfFile(data);
+        if (mapping) CloseHandle(mapping);
+        if (fileHandle != INVALID_HANDLE_VALUE) CloseHandle(fileHandle);
+#else
+        if (data) munmap(const_cast<unsigned char*>(data), size);
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+private:
+    MappedFile() {}
+#ifdef _WIN32
+    HANDLE fileHandle = INVALID_HANDLE_VALUE;
+    HANDLE mapping = NULL;
+#endif
+};
+
+// Validated view over a mapped .meshbin. All pointers point into the mapping.
+class MeshCacheView
+{
+public:
+    std::shared_ptr<MappedFile> file;
+    const MeshCacheHeader *header = nullptr;
+
+    // Opens cachePath and checks it against the source asset. Fails (returns false) on any
+    // mismatch so the caller falls back to Assimp and rebakes.
+    bool open(const std::string &cachePath, uint64_t sourceHash, uint64_t sourceSize, uint32_t vertexStride)
+    {
+        file = MappedFile::open(cachePath);
+        if (!file || file->size < sizeof(MeshCacheHeader))
+            return false;
+
+        header = reinterpret_cast<const MeshCacheHeader*>(file->data);
+        if (std::memcmp(header->magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC)) != 0 ||
+            header->version != MESH_CACHE_VERSION ||
+            header->endianTag != MESH_CACHE_ENDIAN_TAG ||
+            header->vertexStride != vertexStride ||
+            header->fileSize != file->size)
+            return false;
+        if (header->sourceHash != sourceHash || header->sourceSize != sourceSize)
+            return false; // source asset changed since the bake
+
+        if (!inBounds(header->meshTableOffset, (uint64_t)header->meshCount * sizeof(MeshCacheMeshRecord)) ||
+            !inBounds(header->textureRefOffset, (uint64_t)header->textureRefCount * sizeof(MeshCacheTextureRef)) ||
+            !inBounds(header->embeddedTableOffset, (uint64_t)header->embeddedTextureCount * sizeof(MeshCacheEmbeddedTexture)))
+            return false;
+
+        for (uint32_t i = 0; i < header->meshCount; i++)
+        {
+            const MeshCacheMeshRecord &m = meshes()[i];
+            if (!inBounds(m.vertexOffset, (uint64_t)m.vertexCount * vertexStride) ||
+                !inBounds(m.indexOffset, (uint64_t)m.indexCount * sizeof(uint32_t)) ||
+                !inBounds(m.nameOffset, m.nameLength) ||
+                (uint64_t)m.firstTextureRef + m.textureRefCount > header->textureRefCount ||
+                m.lodCount == 0 || m.lodCount > MESH_CACHE_MAX_LODS)
+                return false;
+            for (uint32_t l = 0; l < m.lodCount; l++)
+                if ((uint64_t)m.lods[l].firstIndex + m.lods[l].indexCount > m.indexCount)
+                    return false;
+        }
+        for (uint32_t i = 0; i < header->textureRefCount; i++)
+        {
+            const MeshCacheTextureRef &t = textureRefs()[i];
+            if (!inBounds(t.pathOffset, t.pathLength) || !inBounds(t.typeOffset, t.typeLength))
+                return false;
+        }
+        for (uint32_t i = 0; i < header->embeddedTextureCount; i++)
+        {
+            if (!inBounds(embeddedTextures()[i].dataOffset, embeddedTextures()[i].size))
+                return false;
+        }
+        return true;
+    }
+
+    const MeshCacheMeshRecord *meshes() const { return reinterpret_cast<const MeshCacheMeshRecord*>(file->data + header->meshTableOffset); }
+    const MeshCacheTextureRef *textureRefs() const { return reinterpret_cast<const MeshCacheTextureRef*>(file->data + header->textureRefOffset); }
+    const MeshCacheEmbeddedTexture *embeddedTextures() const { return reinterpret_cast<const MeshCacheEmbeddedTexture*>(file->data + header->embeddedTableOffset); }
+    const unsigned char *at(uint64_t offset) const { return file->data + offset; }
+    std::string string(uint32_t offset, uint32_t length) const { return std::string(reinterpret_cast<const char*>(file->data + offset), length); }
+
+private:
+    bool inBounds(uint64_t offset, uint64_t length) const
+    {
+        return offset <= file->size && length <= file->size - offset;
+    }
+};
+
+// Input for MeshCacheWriter, filled from the freshly processed Assimp meshes.
+struct MeshCacheSourceMesh {
+    const void         *vertices;
+    uint32_t            vertexCount;
+    const uint32_t     *indices;
+    uint32_t            indexCount;
+    uint32_t            lodCount;
+    MeshCacheLod        lods[MESH_CACHE_MAX_LODS];
+    std::string         name;
+    float               minAABB[3];
+    float               maxAABB[3];
+    std::vector<std::pair<std::string, std::string>> textures; // (path, type)
+};
+
+struct MeshCacheSourceTexture {
+    const void *data;
+    uint64_t    size;
+};
+
+class MeshCacheWriter
+{
+public:
+    // Writes the cache to a temporary file and renames it into place, so a crash mid-write
+    // never leaves a truncated cache that looks valid. The temporary name is unique per
+    // writer because several load jobs may bake the same asset at once.
+    static bool write(const std::string &cachePath, uint64_t sourceHash, uint64_t sourceSize, uint32_t vertexStride,
+                      const std::vector<MeshCacheSourceMesh> &meshes, const std::vector<MeshCacheSourceTexture> &embedded)
+    {
+        std::vector<unsigned char> blob;
+        MeshCacheHeader header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC));
+        header.version = MESH_CACHE_VERSION;
+        header.endianTag = MESH_CACHE_ENDIAN_TAG;
+        header.vertexStride = vertexStride;
+        header.meshCount = (uint32_t)meshes.size();
+        header.embeddedTextureCount = (uint32_t)embedded.size();
+        header.sourceHash = sourceHash;
+        header.sourceSize = sourceSize;
+        for (const MeshCacheSourceMesh &m : meshes)
+            header.textureRefCount += (uint32_t)m.textures.size();
+
+        // Reserve the fixed-size tables up front, then append variable-size blocks.
+        reserve(blob, sizeof(MeshCacheHeader));
+        header.meshTableOffset = reserve(blob, header.meshCount * sizeof(MeshCacheMeshRecord));
+        header.textureRefOffset = reserve(blob, header.textureRefCount * sizeof(MeshCacheTextureRef));
+        header.embeddedTableOffset = reserve(blob, header.embeddedTextureCount * sizeof(MeshCacheEmbeddedTexture));
+
+        // Strings go first so their (32-bit) offsets stay small; the bulk data follows.
+        std::vector<MeshCacheMeshRecord> records(meshes.size());
+        std::vector<MeshCacheTextureRef> refs;
+        for (size_t i = 0; i < meshes.size(); i++)
+        {
+            const MeshCacheSourceMesh &m = meshes[i];
+            MeshCacheMeshRecord &r = records[i];
+            r.vertexCount = m.vertexCount;
+            r.indexCount = m.indexCount;
+            r.lodCount = m.lodCount;
+            std::memcpy(r.lods, m.lods, sizeof(r.lods));
+            std::memcpy(r.minAABB, m.minAABB, sizeof(r.minAABB));
+            std::memcpy(r.maxAABB, m.maxAABB, sizeof(r.maxAABB));
+            r.nameLength = (uint32_t)m.name.size();
+            r.nameOffset = (uint32_t)append(blob, m.name.data(), m.name.size(), 1);
+            r.firstTextureRef = (uint32_t)refs.size();
+            r.textureRefCount = (uint32_t)m.textures.size();
+            for (const auto &t : m.textures)
+            {
+                MeshCacheTextureRef ref;
+                ref.pathLength = (uint32_t)t.first.size();
+                ref.pathOffset = (uint32_t)append(blob, t.first.data(), t.first.size(), 1);
+                ref.typeLength = (uint32_t)t.second.size();
+                ref.typeOffset = (uint32_t)append(blob, t.second.data(), t.second.size(), 1);
+                refs.push_back(ref);
+            }
+        }
+        for (size_t i = 0; i < meshes.size(); i++)
+        {
+            records[i].vertexOffset = append(blob, meshes[i].vertices, (size_t)meshes[i].vertexCount * vertexStride, 16);
+            records[i].indexOffset = append(blob, meshes[i].indices, (size_t)meshes[i].indexCount * sizeof(uint32_t), 16);
+        }
+        std::vector<MeshCacheEmbeddedTexture> textures(embedded.size());
+        for (size_t i = 0; i < embedded.size(); i++)
+        {
+            textures[i].size = embedded[i].size;
+            textures[i].dataOffset = append(blob, embedded[i].data, (size_t)embedded[i].size, 16);
+        }
+        header.fileSize = blob.size();
+        std::memcpy(blob.data(), &header, sizeof(header));
+        if (!records.empty())
+            std::memcpy(blob.data() + header.meshTableOffset, records.data(), records.size() * sizeof(MeshCacheMeshRecord));
+        if (!refs.empty())
+            std::memcpy(blob.data() + header.textureRefOffset, refs.data(), refs.size() * sizeof(MeshCacheTextureRef));
+        if (!textures.empty())
+            std::memcpy(blob.data() + header.embeddedTableOffset, textures.data(), textures.size() * sizeof(MeshCacheEmbeddedTexture));
+
+        static std::atomic<unsigned int> writeCounter(0);
+        std::string tmpPath = cachePath + ".tmp" + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()) % 100000)
+                              + "_" + std::to_string(writeCounter++);
+        {
+            std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+            if (!out)
+                return false;
+            out.write(reinterpret_cast<const char*>(blob.data()), (std::streamsize)blob.size());
+            if (!out)
+                return false;
+        }
+        std::remove(cachePath.c_str()); // rename() won't replace an existing file on Windows
+        return std::rename(tmpPath.c_str(), cachePath.c_str()) == 0;
+    }
+
+private:
+    static uint64_t reserve(std::vector<unsigned char> &blob, size_t size)
+    {
+        return append(blob, nullptr, size, 16);
+    }
+
+    static uint64_t append(std::vector<unsigned char> &blob, const void *data, size_t size, size_t alignment)
+    {
+        size_t offset = (blob.size() + alignment - 1) / alignment * alignment;
+        blob.resize(offset + size, 0);
+        if (data && size)
+            std::memcpy(blob.data() + offset, data, size);
+        return offset;
+    }
+};
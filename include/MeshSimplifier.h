@@ -0,0 +1,431 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+const int MAX_MESH_LODS = 4;    // LOD 0 (the source triangles) plus up to 3 simplified levels
+
+// One level of detail of a mesh: a range of its index buffer, drawn with the same vertices
+struct MeshLod {
+    uint32_t firstIndex = 0;
+    uint32_t indexCount = 0;
+    float    error = 0.0f;      // model units the surface may have moved away from LOD 0
+};
+
+// Quadric error metric edge-collapse simplifier (Garland & Heckbert).
+//
+// Vertices sharing a position are welded first, so UV and normal seams don't tear the surface open.
+// Every welded vertex carries the area-weighted plane quadrics of its triangles, plus planes standing
+// on open edges so borders keep their outline. Edges are collapsed in passes, cheapest first, each
+// onto whichever endpoint costs less; a collapse that would flip a triangle is rejected. A vertex
+// always collapses onto another existing vertex (the seam sibling with the closest UV), so every
+// level indexes the original vertex buffer and a LOD only costs its indices.
+class MeshSimplifier
+{
+public:
+    static const uint32_t MIN_TRIANGLES = 64;   // smaller meshes keep a single level
+    static constexpr float MAX_ERROR = 0.1f;    // collapses stop once they move the surface this much, relative to the mesh's size
+    static constexpr float MIN_REDUCTION = 0.8f;// a level must keep at most this share of the previous one's triangles
+
+    // Appends LOD 1.. index lists to indices (which hold LOD 0, a triangle list into vertices) and
+    // fills lods; each level aims at half the triangles of the previous one. Returns the number of
+    // levels, 1 when the mesh is too small or can't be simplified further. VertexT needs Position
+    // and TexCoords. Runs on any thread.
+    template <class VertexT>
+    static int BuildLods(const std::vector<VertexT> &vertices, std::vector<unsigned int> &indices, MeshLod lods[MAX_MESH_LODS])
+    {
+        lods[0] = MeshLod();
+        lods[0].indexCount = (uint32_t)indices.size();
+        uint32_t sourceTriangles = (uint32_t)(indices.size() / 3);
+        if (sourceTriangles < MIN_TRIANGLES)
+            return 1;
+
+        MeshSimplifier simplifier;
+        simplifier.setup(vertices, indices);
+        int levels = 1;
+        uint32_t previousTriangles = sourceTriangles;
+        for (; levels < MAX_MESH_LODS; levels++)
+        {
+            simplifier.reduceTo(previousTriangles / 2);
+            uint32_t triangles = simplifier.triangleCount();
+            if (triangles == 0 || triangles > previousTriangles * MIN_REDUCTION)
+                break;
+
+            MeshLod &lod = lods[levels];
+            lod.firstIndex = (uint32_t)indices.size();
+            lod.indexCount = triangles * 3;
+            lod.error = std::sqrt(simplifier.maxError);
+            indices.insert(indices.end(), simplifier.corners.begin(), simplifier.corners.end());
+            previousTriangles = triangles;
+        }
+        return levels;
+    }
+
+    // indices (a triangle list into vertices) reduced to about targetTriangles, or fewer collapses if
+    // they'd move the surface more than MAX_ERROR allows. error receives how far it did move.
+    template <class VertexT>
+    static std::vector<unsigned int> Simplify(const std::vector<VertexT> &vertices, const std::vector<unsigned int> &indices,
+                                              uint32_t targetTriangles, float &error)
+    {
+        MeshSimplifier simplifier;
+        simplifier.setup(vertices, indices);
+        simplifier.reduceTo(targetTriangles);
+        error = std::sqrt((float)simplifier.maxError);
+        return simplifier.corners;
+    }
+
+private:
+    // Sum of weighted squared distances to a set of planes: Q(p) = p.A.p + 2 b.p + c
+    struct Quadric {
+        double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+        double b0 = 0, b1 = 0, b2 = 0, c = 0;
+        double weight = 0;
+
+        void addPlane(const glm::vec3 &n, float d, double w)
+        {
+            a00 += w * n.x * n.x; a01 += w * n.x * n.y; a02 += w * n.x * n.z;
+            a11 += w * n.y * n.y; a12 += w * n.y * n.z; a22 += w * n.z * n.z;
+            b0 += w * n.x * d; b1 += w * n.y * d; b2 += w * n.z * d;
+            c += w * d * d;
+            weight += w;
+        }
+
+        void add(const Quadric &q)
+        {
+            a00 += q.a00; a01 += q.a01; a02 += q.a02; a11 += q.a11; a12 += q.a12; a22 += q.a22;
+            b0 += q.b0; b1 += q.b1; b2 += q.b2; c += q.c;
+            weight += q.weight;
+        }
+
+        // Mean squared distance of p to the planes
+        double error(const glm::vec3 &p) const
+        {
+            double x = p.x, y = p.y, z = p.z;
+            double e = x * (a00 * x + 2.0 * (a01 * y + a02 * z + b0))
+                     + y * (a11 * y + 2.0 * (a12 * z + b1))
+                     + z * (a22 * z + 2.0 * b2) + c;
+            return weight > 0.0 ? std::max(e, 0.0) / weight : 0.0;
+        }
+    };
+
+    struct Collapse {
+        float cost;
+        uint32_t from, to;  // welded vertices; from is removed
+        bool operator<(const Collapse &other) const { return cost < other.cost; }
+    };
+
+    static constexpr float BORDER_WEIGHT = 10.0f;
+
+    // Welded vertices
+    std::vector<glm::vec3> positions;
+    std::vector<Quadric> quadrics;
+    std::vector<uint32_t> collapsedInto;        // itself until collapsed
+    std::vector<uint32_t> siblingStart, siblings;   // original vertices of each welded vertex
+    // Original vertices
+    std::vector<uint32_t> welded;
+    std::vector<glm::vec2> texCoords;
+    // Current triangles, as original vertex indices
+    std::vector<unsigned int> corners;
+    double maxError = 0.0;          // largest collapse cost so far (squared model units)
+    double errorLimit = 0.0;
+
+    // Scratch, reused by every pass
+    std::vector<uint64_t> edgeKeys;
+    std::vector<Collapse> collapses;
+    std::vector<uint32_t> triangleStart, vertexTriangles;
+    std::vector<unsigned char> locked;
+    std::vector<uint32_t> replacement;
+
+    uint32_t triangleCount() const { return (uint32_t)(corners.size() / 3); }
+
+    template <class VertexT>
+    void setup(const std::vector<VertexT> &vertices, const std::vector<unsigned int> &indices)
+    {
+        size_t vertexCount = vertices.size();
+        welded.resize(vertexCount);
+        texCoords.resize(vertexCount);
+        glm::vec3 minP(0.0f), maxP(0.0f);
+        if (vertexCount > 0)
+            minP = maxP = vertices[0].Position;
+
+        // Weld exact duplicates through an open-addressing table of welded vertex ids
+        size_t tableSize = 1;
+        while (tableSize < vertexCount * 2)
+            tableSize <<= 1;
+        std::vector<uint32_t> table(tableSize, UINT32_MAX);
+        for (size_t v = 0; v < vertexCount; v++)
+        {
+            const glm::vec3 &p = vertices[v].Position;
+            texCoords[v] = vertices[v].TexCoords;
+            minP = glm::min(minP, p);
+            maxP = glm::max(maxP, p);
+            size_t slot = hashPosition(p) & (tableSize - 1);
+            while (table[slot] != UINT32_MAX && positions[table[slot]] != p)
+                slot = (slot + 1) & (tableSize - 1);
+            if (table[slot] == UINT32_MAX)
+            {
+                table[slot] = (uint32_t)positions.size();
+                positions.push_back(p);
+            }
+            welded[v] = table[slot];
+        }
+
+        size_t weldedCount = positions.size();
+        collapsedInto.resize(weldedCount);
+        for (size_t i = 0; i < weldedCount; i++)
+            collapsedInto[i] = (uint32_t)i;
+        siblingStart.assign(weldedCount + 1, 0);
+        for (size_t v = 0; v < vertexCount; v++)
+            siblingStart[welded[v] + 1]++;
+        for (size_t i = 0; i < weldedCount; i++)
+            siblingStart[i + 1] += siblingStart[i];
+        siblings.resize(vertexCount);
+        std::vector<uint32_t> fill(siblingStart.begin(), siblingStart.end() - 1);
+        for (size_t v = 0; v < vertexCount; v++)
+            siblings[fill[welded[v]]++] = (uint32_t)v;
+
+        // Triangles that are already degenerate once welded never show up in a LOD
+        corners.reserve(indices.size());
+        for (size_t i = 0; i + 2 < indices.size(); i += 3)
+        {
+            uint32_t a = welded[indices[i]], b = welded[indices[i + 1]], c = welded[indices[i + 2]];
+            if (a != b && b != c && a != c)
+                corners.insert(corners.end(), indices.begin() + i, indices.begin() + i + 3);
+        }
+
+        quadrics.assign(weldedCount, Quadric());
+        for (size_t i = 0; i < corners.size(); i += 3)
+        {
+            glm::vec3 normal;
+            float area;
+            if (!triangleNormal(i, normal, area))
+                continue;
+            float d = -glm::dot(normal, positions[welded[corners[i]]]);
+            for (int k = 0; k < 3; k++)
+                quadrics[welded[corners[i + k]]].addPlane(normal, d, area);
+        }
+        addBorderQuadrics();
+
+        float size = glm::length(maxP - minP);
+        errorLimit = (double)(MAX_ERROR * size) * (MAX_ERROR * size);
+    }
+
+    // Open edges (used by one triangle) get a plane through them, perpendicular to their triangle
+    void addBorderQuadrics()
+    {
+        std::vector<std::pair<uint64_t, uint32_t>> edges;   // (edge key, corner index of its start)
+        edges.reserve(corners.size());
+        for (size_t i = 0; i < corners.size(); i += 3)
+            for (int k = 0; k < 3; k++)
+                edges.emplace_back(edgeKey(welded[corners[i + k]], welded[corners[i + (k + 1) % 3]]), (uint32_t)(i + k));
+        std::sort(edges.begin(), edges.end());
+
+        for (size_t e = 0; e < edges.size(); e++)
+        {
+            bool shared = (e > 0 && edges[e - 1].first == edges[e].first) ||
+                          (e + 1 < edges.size() && edges[e + 1].first == edges[e].first);
+            if (shared)
+                continue;
+            uint32_t corner = edges[e].second;
+            size_t triangle = corner - corner % 3;
+            glm::vec3 normal;
+            float area;
+            if (!triangleNormal(triangle, normal, area))
+                continue;
+            uint32_t a = welded[corners[corner]];
+            uint32_t b = welded[corners[triangle + (corner - triangle + 1) % 3]];
+            glm::vec3 edge = positions[b] - positions[a];
+            glm::vec3 border = glm::cross(edge, normal);
+            float length = glm::length(border);
+            if (length <= 0.0f)
+                continue;
+            border /= length;
+            float d = -glm::dot(border, positions[a]);
+            double weight = BORDER_WEIGHT * glm::dot(edge, edge);
+            quadrics[a].addPlane(border, d, weight);
+            quadrics[b].addPlane(border, d, weight);
+        }
+    }
+
+    void reduceTo(uint32_t target)
+    {
+        while (triangleCount() > target)
+            if (collapsePass(target) == 0)
+                break;
+    }
+
+    // One round of independent collapses, at most enough to get down to target triangles.
+    // Collapses lock the one-ring of the removed vertex, so the flip test of every collapse in the
+    // pass sees the final triangles. Returns the number of collapses done.
+    uint32_t collapsePass(uint32_t target)
+    {
+        size_t weldedCount = positions.size();
+        buildAdjacency();
+
+        // Candidate edges with their cheaper direction
+        edgeKeys.clear();
+        for (size_t i = 0; i < corners.size(); i += 3)
+            for (int k = 0; k < 3; k++)
+                edgeKeys.push_back(edgeKey(welded[corners[i + k]], welded[corners[i + (k + 1) % 3]]));
+        std::sort(edgeKeys.begin(), edgeKeys.end());
+        edgeKeys.erase(std::unique(edgeKeys.begin(), edgeKeys.end()), edgeKeys.end());
+        collapses.clear();
+        for (uint64_t key : edgeKeys)
+        {
+            uint32_t a = (uint32_t)(key >> 32), b = (uint32_t)key;
+            Quadric q = quadrics[a];
+            q.add(quadrics[b]);
+            double intoA = q.error(positions[a]), intoB = q.error(positions[b]);
+            if (intoB <= intoA)
+                collapses.push_back(Collapse{ (float)intoB, a, b });
+            else
+                collapses.push_back(Collapse{ (float)intoA, b, a });
+        }
+        std::sort(collapses.begin(), collapses.end());
+
+        // Each collapse removes about two triangles
+        uint32_t budget = (triangleCount() - target + 1) / 2 + 1;
+        uint32_t done = 0;
+        locked.assign(weldedCount, 0);
+        for (const Collapse &collapse : collapses)
+        {
+            if (done >= budget || collapse.cost > errorLimit)
+                break;
+            if (locked[collapse.from] || locked[collapse.to] || flips(collapse.from, collapse.to))
+                continue;
+
+            for (uint32_t t = triangleStart[collapse.from]; t < triangleStart[collapse.from + 1]; t++)
+                for (int k = 0; k < 3; k++)
+                    locked[welded[corners[vertexTriangles[t] + k]]] = 1;
+            locked[collapse.to] = 1;
+            collapsedInto[collapse.from] = collapse.to;
+            quadrics[collapse.to].add(quadrics[collapse.from]);
+            maxError = std::max(maxError, (double)collapse.cost);
+            done++;
+        }
+        if (done > 0)
+            applyCollapses();
+        return done;
+    }
+
+    // vertexTriangles[triangleStart[v] .. triangleStart[v + 1]) are the first corners of welded vertex v's triangles
+    void buildAdjacency()
+    {
+        size_t weldedCount = positions.size();
+        triangleStart.assign(weldedCount + 1, 0);
+        for (unsigned int corner : corners)
+            triangleStart[welded[corner] + 1]++;
+        for (size_t i = 0; i < weldedCount; i++)
+            triangleStart[i + 1] += triangleStart[i];
+        vertexTriangles.resize(corners.size());
+        std::vector<uint32_t> fill(triangleStart.begin(), triangleStart.end() - 1);
+        for (size_t i = 0; i < corners.size(); i++)
+            vertexTriangles[fill[welded[corners[i]]]++] = (uint32_t)(i - i % 3);
+    }
+
+    // Would moving welded vertex from onto to turn one of from's remaining triangles over (or flat)?
+    bool flips(uint32_t from, uint32_t to) const
+    {
+        for (uint32_t t = triangleStart[from]; t < triangleStart[from + 1]; t++)
+        {
+            uint32_t triangle = vertexTriangles[t];
+            glm::vec3 before[3], after[3];
+            bool removed = false;
+            for (int k = 0; k < 3; k++)
+            {
+                uint32_t w = welded[corners[triangle + k]];
+                removed |= w == to;
+                before[k] = positions[w];
+                after[k] = positions[w == from ? to : w];
+            }
+            if (removed)
+                continue;
+            glm::vec3 n0 = glm::cross(before[1] - before[0], before[2] - before[0]);
+            glm::vec3 n1 = glm::cross(after[1] - after[0], after[2] - after[0]);
+            if (glm::dot(n0, n0) > 0.0f && glm::dot(n0, n1) <= 0.0f)
+                return true;
+        }
+        return false;
+    }
+
+    // Moves the corners of collapsed vertices onto their targets and drops the triangles that vanished
+    void applyCollapses()
+    {
+        replacement.assign(welded.size(), UINT32_MAX);
+        size_t kept = 0;
+        for (size_t i = 0; i < corners.size(); i += 3)
+        {
+            unsigned int v[3];
+            for (int k = 0; k < 3; k++)
+            {
+                v[k] = corners[i + k];
+                uint32_t w = welded[v[k]];
+                if (collapsedInto[w] != w)
+                {
+                    if (replacement[v[k]] == UINT32_MAX)
+                        replacement[v[k]] = closestSibling(collapsedInto[w], texCoords[v[k]]);
+                    v[k] = replacement[v[k]];
+                }
+            }
+            if (welded[v[0]] == welded[v[1]] || welded[v[1]] == welded[v[2]] || welded[v[0]] == welded[v[2]])
+                continue;
+            corners[kept++] = v[0];
+            corners[kept++] = v[1];
+            corners[kept++] = v[2];
+        }
+        corners.resize(kept);
+        // Collapsed vertices are gone from every triangle; the next pass starts from the new ones
+        for (size_t i = 0; i < collapsedInto.size(); i++)
+            if (collapsedInto[i] != i)
+                collapsedInto[i] = (uint32_t)i, quadrics[i] = Quadric();
+    }
+
+    // The original vertex at welded vertex w whose UV is nearest uv
+    uint32_t closestSibling(uint32_t w, const glm::vec2 &uv) const
+    {
+        uint32_t best = siblings[siblingStart[w]];
+        float bestDistance = INFINITY;
+        for (uint32_t s = siblingStart[w]; s < siblingStart[w + 1]; s++)
+        {
+            glm::vec2 delta = texCoords[siblings[s]] - uv;
+            float distance = glm::dot(delta, delta);
+            if (distance < bestDistance)
+            {
+                bestDistance = distance;
+                best = siblings[s];
+            }
+        }
+        return best;
+    }
+
+    // Unit normal and area of the triangle starting at corner i; false if it has no area
+    bool triangleNormal(size_t i, glm::vec3 &normal, float &area) const
+    {
+        const glm::vec3 &p0 = positions[welded[corners[i]]];
+        glm::vec3 n = glm::cross(positions[welded[corners[i + 1]]] - p0, positions[welded[corners[i + 2]]] - p0);
+        float length = glm::length(n);
+        if (length <= 0.0f)
+            return false;
+        normal = n / length;
+        area = 0.5f * length;
+        return true;
+    }
+
+    static uint64_t edgeKey(uint32_t a, uint32_t b)
+    {
+        return a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+    }
+
+    static size_t hashPosition(const glm::vec3 &p)
+    {
+        uint32_t bits[3];
+        std::memcpy(bits, &p, sizeof(bits));
+        return (size_t)(bits[0] * 73856093u ^ bits[1] * 19349663u ^ bits[2] * 83492791u);
+    }
+};
@@ -4,22 +4,37 @@
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
-#include "stb_image.h"
+#include <glm/gtc/packing.hpp>
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
 #include "Shader.h"
-
+#include "GeometryArena.h"
+#include "GLStateCache.h"
+#include "InstanceBuffer.h"
+#include "JobSystem.h"
+#include "MeshCache.h"
+#include "MeshSimplifier.h"
+#include "TextureCache.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <memory>
 #include <string>
+#include <unordered_map>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <map>
 #include <vector>
 
-// Forward declaration
-unsigned int TextureFromFile(const char *path, const std::string &directory, const aiScene* scene);
+// Compressed bytes of an embedded ("*N") texture, either owned by the aiScene or mapped from a .meshbin
+struct EmbeddedTexture {
+    const unsigned char *data;
+    unsigned int size;
+};
 
 struct Vertex {
     glm::vec3 Position;
@@ -27,132 +42,613 @@ struct Vertex {
     glm::vec2 TexCoords;
 };
 
+// Points attributes 0-2 of the bound VAO at Vertex data in the bound GL_ARRAY_BUFFER
+inline void SetVertexAttributes()
+{
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+}
+
+// Optional GPU format, half the size of Vertex. The vertex shaders dequantize it (shaders/packed_vertex.glsl):
+//   Position  - 16-bit steps across the box given by positionOffset / positionScale (the model's bounds)
+//   Normal    - octahedral encoding, 16-bit signed steps of 1/32767
+//   TexCoords - half floats
+// The CPU side (collision, LOD, HLOD, the .meshbin) always keeps the float Vertex.
+struct PackedVertex {
+    uint16_t Position[4];   // [3] is padding
+    int16_t  Normal[2];
+    uint16_t TexCoords[2];
+};
+static_assert(sizeof(PackedVertex) == 16, "PackedVertex must stay 16 bytes");
+
+inline void SetPackedVertexAttributes()
+{
+    // Integer attributes are read as plain floats (not normalized), the shaders apply the steps
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_FALSE, sizeof(PackedVertex), (void*)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_SHORT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Normal));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, TexCoords));
+}
+
+// Whether meshes are uploaded as PackedVertex. Set once at startup, before the first mesh is created.
+inline bool &UsePackedVertices()
+{
+    static bool packed = false;
+    return packed;
+}
+
+// Every Mesh's vertices and indices are a slice of this arena (one per vertex format)
+inline GeometryArena &MeshArena()
+{
+    static GeometryArena floats("meshes", sizeof(Vertex), SetVertexAttributes);
+    static GeometryArena packed("packed meshes", sizeof(PackedVertex), SetPackedVertexAttributes);
+    return UsePackedVertices() ? packed : floats;
+}
+
+// Box PackedVertex positions are quantized in
+struct PackBounds {
+    glm::vec3 min;
+    glm::vec3 max;
+};
+
+// Largest difference between packed vertices and the float ones they came from
+struct PackingError {
+    float position = 0.0f;      // model units
+    float normalDegrees = 0.0f;
+    float texCoord = 0.0f;
+
+    void merge(const PackingError &other)
+    {
+        position = std::max(position, other.position);
+        normalDegrees = std::max(normalDegrees, other.normalDegrees);
+        texCoord = std::max(texCoord, other.texCoord);
+    }
+};
+
+inline glm::vec2 OctEncode(glm::vec3 n)
+{
+    float sum = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    if (sum == 0.0f)
+        return glm::vec2(0.0f);
+    n /= sum;
+    if (n.z >= 0.0f)
+        return glm::vec2(n.x, n.y);
+    return glm::vec2((1.0f - std::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f),
+                     (1.0f - std::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f));
+}
+
+// Same as octDecode in the vertex shaders
+inline glm::vec3 OctDecode(glm::vec2 e)
+{
+    glm::vec3 n(e.x, e.y, 1.0f - std::abs(e.x) - std::abs(e.y));
+    float t = std::max(-n.z, 0.0f);
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+    return glm::normalize(n);
+}
+
+// positionStep is the model-space size of one 16-bit position step (positionScale)
+inline PackedVertex PackVertex(const Vertex &vertex, const glm::vec3 &offset, const glm::vec3 &positionStep)
+{
+    PackedVertex packed;
+    for (int k = 0; k < 3; k++)
+    {
+        float steps = (vertex.Position[k] - offset[k]) / positionStep[k];
+        packed.Position[k] = (uint16_t)std::min(std::max(std::round(steps), 0.0f), 65535.0f);
+    }
+    packed.Position[3] = 0;
+    glm::vec2 octahedral = OctEncode(vertex.Normal);
+    for (int k = 0; k < 2; k++)
+        packed.Normal[k] = (int16_t)std::round(std::min(std::max(octahedral[k], -1.0f), 1.0f) * 32767.0f);
+    packed.TexCoords[0] = glm::packHalf1x16(vertex.TexCoords.x);
+    packed.TexCoords[1] = glm::packHalf1x16(vertex.TexCoords.y);
+    return packed;
+}
+
+// What the vertex shaders reconstruct from a PackedVertex
+inline Vertex UnpackVertex(const PackedVertex &packed, const glm::vec3 &offset, const glm::vec3 &positionStep)
+{
+    Vertex vertex;
+    vertex.Position = offset + glm::vec3((float)packed.Position[0], (float)packed.Position[1], (float)packed.Position[2]) * positionStep;
+    vertex.Normal = OctDecode(glm::vec2(packed.Normal[0], packed.Normal[1]) / 32767.0f);
+    vertex.TexCoords = glm::vec2(glm::unpackHalf1x16(packed.TexCoords[0]), glm::unpackHalf1x16(packed.TexCoords[1]));
+    return vertex;
+}
+
 struct Texture {
     unsigned int id;
     std::string type;
     std::string path;
+    size_t bytes = 0;   // GPU memory, including the mip chain
+    TextureKey key;     // TextureCache key (content hash and size of the encoded image)
 };
 
+static_assert(MAX_MESH_LODS == (int)MESH_CACHE_MAX_LODS && MAX_MESH_LODS == GLStateCache::LOD_LEVELS,
+              "LOD tables must agree between meshes, the .meshbin and the frame counters");
+
+// Level-of-detail selection: the coarsest level whose simplification error stays under LOD_PIXEL_ERROR
+// pixels on screen. A level only changes once the error is LOD_HYSTERESIS past the threshold, so
+// objects sitting at a switching distance don't flicker between two levels.
+const float LOD_PIXEL_ERROR = 1.0f;
+const float LOD_HYSTERESIS = 0.25f;
+
+// errors[i] is how far LOD i moves the surface (model units), pixelsPerUnit how many screen pixels a
+// model unit covers where the object is drawn. previous is the level picked last time, or -1.
+inline int SelectLod(const float *errors, int count, float pixelsPerUnit, int previous)
+{
+    if (previous < 0)
+    {
+        int lod = 0;
+        while (lod + 1 < count && errors[lod + 1] * pixelsPerUnit <= LOD_PIXEL_ERROR)
+            lod++;
+        return lod;
+    }
+    int lod = std::min(previous, count - 1);
+    while (lod > 0 && errors[lod] * pixelsPerUnit > LOD_PIXEL_ERROR * (1.0f + LOD_HYSTERESIS))
+        lod--;
+    while (lod + 1 < count && errors[lod + 1] * pixelsPerUnit < LOD_PIXEL_ERROR * (1.0f - LOD_HYSTERESIS))
+        lod++;
+    return lod;
+}
+
+// Forward declaration
+std::shared_ptr<TextureRecord> DecodeTexture(const std::string &path, const std::string &directory, const std::vector<EmbeddedTexture> &embedded);
+
 class Mesh {
 public:
-    std::vector<Vertex>         vertices;
+    std::vector<Vertex>         vertices;   // empty when the geometry is mapped from a .meshbin
     std::vector<unsigned int>   indices;
     std::vector<Texture>        textures;
-    unsigned int                VAO;
+    unsigned int                VAO = 0;    // the arena page's, shared with the other meshes on it
     glm::vec3                   minAABB;
     glm::vec3                   maxAABB;
     std::string                 name;
+    MeshLod                     lods[MAX_MESH_LODS];    // ranges of the index buffer; lods[0] is the full mesh
+    int                         lodCount = 1;
+    bool                        packed = false;     // uploaded as PackedVertex
+    glm::vec3                   positionOffset = glm::vec3(0.0f);   // dequantization of packed positions
+    glm::vec3                   positionScale = glm::vec3(1.0f);
+    PackingError                packingError;       // measured when packed
+
+    // bounds: box to quantize positions in when packing; nullptr for the mesh's own
+    Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures , std::string name,
+         const PackBounds *bounds = nullptr)
+    {
+        this->vertices  =       std::move(vertices);
+        this->indices   =       std::move(indices);
+        this->textures  =       std::move(textures);
+        this->name      =       std::move(name);
+        setupMesh(bounds);
+
+    }
 
-    Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures , std::string name)
+    // Mesh whose vertex/index blocks live in a memory-mapped .meshbin. Nothing is copied on the CPU;
+    // the blocks are uploaded straight from the mapping, which `backing` keeps alive.
+    Mesh(const Vertex *vertexData, size_t vertexCount, const unsigned int *indexData, size_t indexCount,
+         std::vector<Texture> textures, std::string name, std::shared_ptr<const void> backing,
+         const PackBounds *bounds = nullptr)
     {
-        this->vertices  =       vertices;
-        this->indices   =       indices;
-        this->textures  =       textures;
-        this->name      =       name;
-        setupMesh();
+        this->mappedVertices     =  vertexData;
+        this->mappedVertexCount  =  vertexCount;
+        this->mappedIndices      =  indexData;
+        this->mappedIndexCount   =  indexCount;
+        this->backing            =  std::move(backing);
+        this->textures           =  std::move(textures);
+        this->name               =  std::move(name);
+        setupMesh(bounds);
+    }
 
+    // LOD ranges from the importer (the index buffer holds all of them)
+    void setLods(const MeshLod *levels, int count)
+    {
+        lodCount = std::max(1, std::min(count, MAX_MESH_LODS));
+        for (int i = 0; i < lodCount; i++)
+            lods[i] = levels[i];
     }
 
-    void Draw(Shader &shader) 
+    int selectLod(float pixelsPerUnit, int previous = -1) const
     {
-        for(unsigned int i = 0; i < textures.size(); i++)
+        float errors[MAX_MESH_LODS];
+        for (int i = 0; i < lodCount; i++)
+            errors[i] = lods[i].error;
+        return SelectLod(errors, lodCount, pixelsPerUnit, previous);
+    }
+
+    // Bytes of vertex + index data this mesh holds on the GPU (every LOD; 0 once released)
+    size_t gpuBytes() const
+    {
+        size_t vertexSize = packed ? sizeof(PackedVertex) : sizeof(Vertex);
+        return VAO ? vertexCount() * vertexSize + indexCount() * sizeof(unsigned int) : 0;
+    }
+
+    // Gives the geometry's ranges back to the arena. The CPU copy (if any) is left alone.
+    void release()
+    {
+        MeshArena().free(geometry);
+        VAO = 0;
+    }
+
+    // Where the geometry lives in MeshArena(); index ranges (lods) are relative to slice().firstIndex
+    const GeometrySlice &slice() const { return geometry; }
+
+    const Vertex *vertexData() const { return mappedVertices ? mappedVertices : vertices.data(); }
+    size_t vertexCount() const { return mappedVertices ? mappedVertexCount : vertices.size(); }
+    const unsigned int *indexData() const { return mappedIndices ? mappedIndices : indices.data(); }
+    size_t indexCount() const { return mappedIndices ? mappedIndexCount : indices.size(); }
+
+    // GL name of the texture bound as texture_diffuse1 (unit 0), 0 if the mesh has none
+    unsigned int diffuseTexture() const
+    {
+        unsigned int id = 0;
+        for(const Texture &texture : textures)
+            if(texture.type == "texture_diffuse")
+                id = texture.id;
+        return id;
+    }
+
+    // Sets the packed-position dequantization uniforms of shader (in use) for this mesh
+    void setPositionDequantization(const Shader &shader) const
+    {
+        if (!packed)
+            return;
+        shader.set(shader.positionOffset, positionOffset);
+        shader.set(shader.positionScale, positionScale);
+    }
+
+    // Binds go through GLStateCache, so consecutive draws sharing a texture or VAO don't rebind it.
+    // lod is clamped to the levels this mesh has.
+    void Draw(Shader &shader, int lod = 0)
+    {
+        GLStateCache &gl = GLStateCache::instance();
+        // texture_diffuse1 is bound to unit 0 once when the shader is set up
+        if (unsigned int diffuse = diffuseTexture())
+            gl.bindTexture2D(0, diffuse);
+        
+        lod = std::min(lod, lodCount - 1);
+        setPositionDequantization(shader);
+        gl.bindVertexArray(VAO);
+        glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)lods[lod].indexCount, GL_UNSIGNED_INT, indexOffset(lod),
+                                 (GLint)geometry.baseVertex);
+        gl.countDraw(lod, lods[lod].indexCount / 3);
+    }
+
+    // Draws every instance in `instances` with one call (shader must read locations 3/4, e.g. instanced.vs)
+    void DrawInstanced(Shader &shader, const InstanceBuffer &instances, int lod = 0)
+    {
+        if (instances.count == 0)
+            return;
+        GLStateCache &gl = GLStateCache::instance();
+        if (unsigned int diffuse = diffuseTexture())
+            gl.bindTexture2D(0, diffuse);
+
+        gl.bindVertexArray(VAO);
+        GeometryArena::Page &page = MeshArena().pageOf(geometry);
+        if (page.instanceVBO != instances.VBO)
         {
-            if(textures[i].type == "texture_diffuse")
-            {
-                glActiveTexture(GL_TEXTURE0);
-                shader.setInt("texture_diffuse1", 0);
-                glBindTexture(GL_TEXTURE_2D, textures[i].id);
-            }
+            // Point the per-instance attributes at this buffer (kept in the page's VAO until it changes)
+            page.instanceVBO = instances.VBO;
+            glBindBuffer(GL_ARRAY_BUFFER, page.instanceVBO);
+            glEnableVertexAttribArray(3);
+            glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)offsetof(InstanceData, posScale));
+            glVertexAttribDivisor(3, 1);
+            glEnableVertexAttribArray(4);
+            glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)offsetof(InstanceData, params));
+            glVertexAttribDivisor(4, 1);
         }
-        
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, (GLsizei)indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-        glActiveTexture(GL_TEXTURE0);
+        lod = std::min(lod, lodCount - 1);
+        setPositionDequantization(shader);
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, (GLsizei)lods[lod].indexCount, GL_UNSIGNED_INT, indexOffset(lod),
+                                          instances.count, (GLint)geometry.baseVertex);
+        gl.countInstancedDraw(lod, lods[lod].indexCount / 3, instances.count);
     }
 
 private:
-    unsigned int VBO, EBO;
-    void setupMesh()
-    {
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
+    GeometrySlice geometry;
+    const Vertex        *mappedVertices = nullptr;
+    size_t               mappedVertexCount = 0;
+    const unsigned int  *mappedIndices = nullptr;
+    size_t               mappedIndexCount = 0;
+    std::shared_ptr<const void> backing;
 
-        glBindVertexArray(VAO);
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);  
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+    const void *indexOffset(int lod) const { return (const void*)((geometry.firstIndex + lods[lod].firstIndex) * sizeof(unsigned int)); }
 
-        glEnableVertexAttribArray(0);	
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        glEnableVertexAttribArray(1);	
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        glEnableVertexAttribArray(2);	
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+    void setupMesh(const PackBounds *bounds)
+    {
+        lods[0].indexCount = (uint32_t)indexCount();
+        packed = UsePackedVertices();
+        if (packed)
+        {
+            std::vector<PackedVertex> packedVertices = packVertices(bounds);
+            geometry = MeshArena().allocate(packedVertices.data(), packedVertices.size(), indexData(), indexCount());
+        }
+        else
+        {
+            geometry = MeshArena().allocate(vertexData(), vertexCount(), indexData(), indexCount());
+        }
+        VAO = MeshArena().vertexArray(geometry);
+    }
 
-        glBindVertexArray(0);
+    // Quantizes the vertices and measures what that costs against the float originals
+    std::vector<PackedVertex> packVertices(const PackBounds *bounds)
+    {
+        const Vertex *source = vertexData();
+        size_t count = vertexCount();
+        PackBounds own = { glm::vec3(0.0f), glm::vec3(0.0f) };
+        if (!bounds && count > 0)
+        {
+            own.min = own.max = source[0].Position;
+            for (size_t i = 1; i < count; i++)
+            {
+                own.min = glm::min(own.min, source[i].Position);
+                own.max = glm::max(own.max, source[i].Position);
+            }
+        }
+        if (!bounds)
+            bounds = &own;
+        positionOffset = bounds->min;
+        positionScale = glm::max(bounds->max - bounds->min, glm::vec3(1e-6f)) / 65535.0f;
+
+        std::vector<PackedVertex> out(count);
+        packingError = PackingError();
+        for (size_t i = 0; i < count; i++)
+        {
+            out[i] = PackVertex(source[i], positionOffset, positionScale);
+            Vertex decoded = UnpackVertex(out[i], positionOffset, positionScale);
+            packingError.position = std::max(packingError.position, glm::length(decoded.Position - source[i].Position));
+            float normalLength = glm::length(source[i].Normal);
+            if (normalLength > 0.0f)
+            {
+                float cosine = std::min(std::max(glm::dot(source[i].Normal / normalLength, decoded.Normal), -1.0f), 1.0f);
+                packingError.normalDegrees = std::max(packingError.normalDegrees, glm::degrees(std::acos(cosine)));
+            }
+            glm::vec2 uvError = glm::abs(decoded.TexCoords - source[i].TexCoords);
+            packingError.texCoord = std::max(packingError.texCoord, std::max(uvError.x, uvError.y));
+        }
+        return out;
     }
 };
 
-class Model 
+// CPU-side result of loading one mesh: either owned vectors (fresh Assimp import) or a
+// view into a mapped .meshbin. No GL calls are needed to produce it.
+struct MeshData {
+    std::vector<Vertex>         vertices;
+    std::vector<unsigned int>   indices;
+    const Vertex               *mappedVertices = nullptr;
+    const unsigned int         *mappedIndices = nullptr;
+    size_t                      mappedVertexCount = 0;
+    size_t                      mappedIndexCount = 0;
+    std::vector<std::pair<std::string, std::string>> textures; // (path, type)
+    glm::vec3                   minAABB;
+    glm::vec3                   maxAABB;
+    std::string                 name;
+    MeshLod                     lods[MAX_MESH_LODS];    // index ranges of each level, all in indices
+    int                         lodCount = 1;
+};
+
+// Everything the CPU phase of a model load produces. Safe to build on any thread;
+// Model::upload turns it into GL objects on the context thread.
+struct ModelData {
+    std::string                 path;
+    std::string                 directory;
+    bool                        loaded = false;
+    std::vector<MeshData>       meshes;
+    std::unordered_map<std::string, std::shared_ptr<TextureRecord>> textures;  // by path, shared via TextureCache
+    std::shared_ptr<MappedFile> backing;    // keeps mapped mesh blocks alive
+    bool                        hashed = false;         // source file content hash, for sharing copies of it
+    uint64_t                    sourceHash = 0, sourceSize = 0;
+};
+
+class ModelImporter
 {
 public:
-    std::vector<Texture> textures_loaded;
-    std::vector<Mesh>    meshes;
-    std::string directory;
-
-    Model(std::string const &path)
+    // CPU phase: .meshbin or Assimp parse, vertex conversion and texture decode.
+    static ModelData load(std::string const &path)
     {
-        loadModel(path);
+        uint64_t sourceHash = 0, sourceSize = 0;
+        bool hashed = HashFile(path, sourceHash, sourceSize);
+        return load(path, hashed, sourceHash, sourceSize);
     }
 
-    void Draw(Shader &shader)
-    {
-        for(unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader);
-    }
-    
-private:
-    void loadModel(std::string const &path)
+    // Same, for callers that already hashed the source file (e.g. ModelRegistry).
+    static ModelData load(std::string const &path, bool hashed, uint64_t sourceHash, uint64_t sourceSize)
     {
+        ModelData data;
+        data.path = path;
+        data.directory = path.substr(0, path.find_last_of('/'));
+        data.hashed = hashed;
+        data.sourceHash = sourceHash;
+        data.sourceSize = sourceSize;
+
+        // Try the baked .meshbin first; only import with Assimp when it's missing or stale.
+        std::string cachePath = path + ".meshbin";
+        std::vector<EmbeddedTexture> embeddedTextures;
+        if (hashed && loadFromCache(data, cachePath, sourceHash, sourceSize, embeddedTextures))
+        {
+            decodeTextures(data, embeddedTextures);
+            return data;
+        }
+
         Assimp::Importer importer;
         const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_GenNormals | aiProcess_GenUVCoords);
         
         if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) 
         {
             std::cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << std::endl;
-            return;
+            return data;
+        }
+
+        // Only compressed embedded textures (mHeight == 0) can be decoded by stb_image
+        for(unsigned int i = 0; i < scene->mNumTextures; i++)
+        {
+            const aiTexture* tex = scene->mTextures[i];
+            EmbeddedTexture embedded;
+            embedded.data = reinterpret_cast<const unsigned char*>(tex->pcData);
+            embedded.size = tex->mHeight == 0 ? tex->mWidth : 0;
+            embeddedTextures.push_back(embedded);
+        }
+
+        processNode(data, scene->mRootNode, scene);
+        buildLods(data);
+        data.loaded = true;
+
+        if (hashed)
+            writeCache(data, cachePath, sourceHash, sourceSize, embeddedTextures);
+        decodeTextures(data, embeddedTextures); // before the importer frees the embedded bytes
+        return data;
+    }
+
+private:
+    static bool loadFromCache(ModelData &data, const std::string &cachePath, uint64_t sourceHash, uint64_t sourceSize,
+                              std::vector<EmbeddedTexture> &embeddedTextures)
+    {
+        MeshCacheView cache;
+        if (!cache.open(cachePath, sourceHash, sourceSize, sizeof(Vertex)))
+            return false;
+
+        for(uint32_t i = 0; i < cache.header->embeddedTextureCount; i++)
+        {
+            const MeshCacheEmbeddedTexture &t = cache.embeddedTextures()[i];
+            EmbeddedTexture embedded;
+            embedded.data = cache.at(t.dataOffset);
+            embedded.size = (unsigned int)t.size;
+            embeddedTextures.push_back(embedded);
         }
-        directory = path.substr(0, path.find_last_of('/'));
-        processNode(scene->mRootNode, scene);
+
+        data.meshes.resize(cache.header->meshCount);
+        for(uint32_t i = 0; i < cache.header->meshCount; i++)
+        {
+            const MeshCacheMeshRecord &r = cache.meshes()[i];
+            MeshData &mesh = data.meshes[i];
+            mesh.mappedVertices = reinterpret_cast<const Vertex*>(cache.at(r.vertexOffset));
+            mesh.mappedVertexCount = r.vertexCount;
+            mesh.mappedIndices = reinterpret_cast<const unsigned int*>(cache.at(r.indexOffset));
+            mesh.mappedIndexCount = r.indexCount;
+            mesh.name = cache.string(r.nameOffset, r.nameLength);
+            mesh.minAABB = glm::vec3(r.minAABB[0], r.minAABB[1], r.minAABB[2]);
+            mesh.maxAABB = glm::vec3(r.maxAABB[0], r.maxAABB[1], r.maxAABB[2]);
+            mesh.lodCount = (int)r.lodCount;
+            for(uint32_t l = 0; l < r.lodCount; l++)
+            {
+                mesh.lods[l].firstIndex = r.lods[l].firstIndex;
+                mesh.lods[l].indexCount = r.lods[l].indexCount;
+                mesh.lods[l].error = r.lods[l].error;
+            }
+            for(uint32_t t = 0; t < r.textureRefCount; t++)
+            {
+                const MeshCacheTextureRef &ref = cache.textureRefs()[r.firstTextureRef + t];
+                mesh.textures.push_back(std::make_pair(cache.string(ref.pathOffset, ref.pathLength), cache.string(ref.typeOffset, ref.typeLength)));
+            }
+        }
+        data.backing = cache.file;
+        data.loaded = true;
+        std::cout << "Loaded " << data.meshes.size() << " meshes from cache " << cachePath << std::endl;
+        return true;
     }
 
-    void processNode(aiNode *node, const aiScene *scene)
+    static void writeCache(const ModelData &data, const std::string &cachePath, uint64_t sourceHash, uint64_t sourceSize,
+                           const std::vector<EmbeddedTexture> &embeddedTextures)
+    {
+        std::vector<MeshCacheSourceMesh> sourceMeshes(data.meshes.size());
+        for(size_t i = 0; i < data.meshes.size(); i++)
+        {
+            const MeshData &mesh = data.meshes[i];
+            MeshCacheSourceMesh &out = sourceMeshes[i];
+            out.vertices = mesh.vertices.data();
+            out.vertexCount = (uint32_t)mesh.vertices.size();
+            out.indices = mesh.indices.data();
+            out.indexCount = (uint32_t)mesh.indices.size();
+            out.lodCount = (uint32_t)mesh.lodCount;
+            for(int l = 0; l < mesh.lodCount; l++)
+            {
+                out.lods[l].firstIndex = mesh.lods[l].firstIndex;
+                out.lods[l].indexCount = mesh.lods[l].indexCount;
+                out.lods[l].error = mesh.lods[l].error;
+            }
+            out.name = mesh.name;
+            for(int k = 0; k < 3; k++)
+            {
+                out.minAABB[k] = mesh.minAABB[k];
+                out.maxAABB[k] = mesh.maxAABB[k];
+            }
+            out.textures = mesh.textures;
+        }
+        std::vector<MeshCacheSourceTexture> sourceTextures;
+        for(const EmbeddedTexture &t : embeddedTextures)
+            sourceTextures.push_back(MeshCacheSourceTexture{ t.data, t.size });
+
+        if (!MeshCacheWriter::write(cachePath, sourceHash, sourceSize, sizeof(Vertex), sourceMeshes, sourceTextures))
+            std::cout << "WARNING::MESHCACHE:: could not write " << cachePath << std::endl;
+    }
+
+    // Simplified levels of detail of every mesh (see MeshSimplifier), one job per mesh. Baked into
+    // the .meshbin, so this only runs on a cold load.
+    static void buildLods(ModelData &data)
+    {
+        JobSystem::instance().parallelFor((uint32_t)data.meshes.size(), 1, [&](uint32_t begin, uint32_t end) {
+            for(uint32_t i = begin; i < end; i++)
+            {
+                MeshData &mesh = data.meshes[i];
+                mesh.lodCount = MeshSimplifier::BuildLods(mesh.vertices, mesh.indices, mesh.lods);
+            }
+        });
+    }
+
+    // Resolves every distinct texture path through the global TextureCache, which only
+    // decodes images whose content it hasn't seen yet. One job per image.
+    static void decodeTextures(ModelData &data, const std::vector<EmbeddedTexture> &embeddedTextures)
+    {
+        std::vector<std::string> paths;
+        for(const MeshData &mesh : data.meshes)
+        {
+            for(const auto &ref : mesh.textures)
+            {
+                if (data.textures.find(ref.first) == data.textures.end())
+                {
+                    data.textures[ref.first] = nullptr;
+                    paths.push_back(ref.first);
+                }
+            }
+        }
+        std::vector<std::shared_ptr<TextureRecord>> records(paths.size());
+        JobSystem::instance().parallelFor((uint32_t)paths.size(), 1, [&](uint32_t begin, uint32_t end) {
+            for(uint32_t i = begin; i < end; i++)
+                records[i] = DecodeTexture(paths[i], data.directory, embeddedTextures);
+        });
+        for(size_t i = 0; i < paths.size(); i++)
+            data.textures[paths[i]] = records[i];
+    }
+
+    static void processNode(ModelData &data, aiNode *node, const aiScene *scene)
     {
         for(unsigned int i = 0; i < node->mNumMeshes; i++)
         {
             aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            data.meshes.push_back(processMesh(mesh, scene));
         }
         for(unsigned int i = 0; i < node->mNumChildren; i++)
         {
-            processNode(node->mChildren[i], scene);
+            processNode(data, node->mChildren[i], scene);
         }
     }
 
-    Mesh processMesh(aiMesh *mesh, const aiScene *scene)
+    static MeshData processMesh(aiMesh *mesh, const aiScene *scene)
     {
-        std::vector<Vertex> vertices;
-        std::vector<unsigned int> indices;
-        std::vector<Texture> textures;
+        MeshData out;
+        std::vector<Vertex> &vertices = out.vertices;
+        std::vector<unsigned int> &indices = out.indices;
+        vertices.resize(mesh->mNumVertices);
 
         glm::vec3 minAABB = glm::vec3(mesh->mVertices[0].x, mesh->mVertices[0].y, mesh->mVertices[0].z);
         glm::vec3 maxAABB = minAABB;
 
         for(unsigned int i = 0 ; i < mesh -> mNumVertices ; i++){
-            Vertex vertex;
+            Vertex &vertex = vertices[i];
             vertex.Position = glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
 
             // Update AABB
@@ -165,119 +661,207 @@ private:
 
             if (mesh -> HasNormals())
                 vertex.Normal = glm::vec3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z);
+            else
+                vertex.Normal = glm::vec3(0.0f, 0.0f, 0.0f);
             if(mesh -> mTextureCoords[0])
                 vertex.TexCoords = glm::vec2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y);
             else
                 vertex.TexCoords = glm::vec2(0.0f, 0.0f);
-            vertices.push_back(vertex);
         }
 
-
+        // Triangulated, so almost every face has 3 indices
+        indices.reserve((size_t)mesh->mNumFaces * 3);
         for(unsigned int i = 0; i < mesh->mNumFaces; i++){
-            aiFace face = mesh->mFaces[i];
-            for(unsigned int j = 0; j < face.mNumIndices; j++)
-                indices.push_back(face.mIndices[j]);
+            const aiFace &face = mesh->mFaces[i];
+            indices.insert(indices.end(), face.mIndices, face.mIndices + face.mNumIndices);
         }
 
         aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];    
-        std::vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse", scene);
-        textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
+        for(unsigned int i = 0; i < material->GetTextureCount(aiTextureType_DIFFUSE); i++)
+        {
+            aiString str;
+            material->GetTexture(aiTextureType_DIFFUSE, i, &str);
+            out.textures.push_back(std::make_pair(std::string(str.C_Str()), std::string("texture_diffuse")));
+        }
 
+        out.name = mesh->mName.C_Str();
+        out.minAABB = minAABB;
+        out.maxAABB = maxAABB;
+        return out;
+    }
+};
 
-        Mesh newMesh(vertices, indices, textures , std::string(mesh->mName.C_Str()));
-        newMesh.minAABB = minAABB;
-        newMesh.maxAABB = maxAABB;
-        return newMesh;
+class Model 
+{
+public:
+    std::vector<Texture> textures_loaded;
+    std::vector<Mesh>    meshes;
+    std::string directory;
+
+    // Empty model, filled in later by upload() (see ModelLoader for the asynchronous path)
+    Model() {}
+
+    Model(std::string const &path)
+    {
+        ModelData data = ModelImporter::load(path);
+        upload(data);
     }
 
-    // --- UPDATED to pass the aiScene to the texture loader ---
-    std::vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, std::string typeName, const aiScene* scene)
+    // GL phase: creates the textures, buffers and VAOs for data. Must run on the context thread.
+    void upload(ModelData &data)
     {
-        std::vector<Texture> textures;
-        for(unsigned int i = 0; i < mat->GetTextureCount(type); i++)
+        directory = data.directory;
+        std::unordered_map<std::string, Texture> byPath;
+        for(auto &entry : data.textures)
         {
-            aiString str;
-            mat->GetTexture(type, i, &str);
-            bool skip = false;
-            for(unsigned int j = 0; j < textures_loaded.size(); j++)
+            if (!entry.second)
+                continue;
+            Texture texture;
+            texture.id = TextureCache::instance().acquire(*entry.second);
+            texture.path = entry.first;
+            texture.bytes = entry.second->bytes;
+            texture.key = entry.second->key;
+            textures_loaded.push_back(texture);
+            byPath[entry.first] = texture;
+        }
+
+        // Packed positions of every mesh are quantized in the model's box, so they share one dequantization
+        PackBounds bounds = { glm::vec3(0.0f), glm::vec3(0.0f) };
+        for(size_t i = 0; i < data.meshes.size(); i++)
+        {
+            bounds.min = i == 0 ? data.meshes[i].minAABB : glm::min(bounds.min, data.meshes[i].minAABB);
+            bounds.max = i == 0 ? data.meshes[i].maxAABB : glm::max(bounds.max, data.meshes[i].maxAABB);
+        }
+
+        meshes.reserve(meshes.size() + data.meshes.size());
+        for(MeshData &mesh : data.meshes)
+        {
+            std::vector<Texture> textures;
+            for(const auto &ref : mesh.textures)
             {
-                if(std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
+                auto it = byPath.find(ref.first);
+                if (it != byPath.end())
                 {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true;
-                    break;
+                    Texture texture = it->second;
+                    texture.type = ref.second;
+                    textures.push_back(texture);
                 }
             }
-            if(!skip)
-            {
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory, scene); // Pass scene pointer
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);
-            }
+
+            if (mesh.mappedVertices)
+                meshes.emplace_back(mesh.mappedVertices, mesh.mappedVertexCount, mesh.mappedIndices, mesh.mappedIndexCount,
+                                    std::move(textures), mesh.name, data.backing, &bounds);
+            else
+                meshes.emplace_back(std::move(mesh.vertices), std::move(mesh.indices), std::move(textures), mesh.name, &bounds);
+            meshes.back().minAABB = mesh.minAABB;
+            meshes.back().maxAABB = mesh.maxAABB;
+            meshes.back().setLods(mesh.lods, mesh.lodCount);
         }
-        return textures;
-    }
-};
 
+        if (UsePackedVertices() && !data.meshes.empty())
+        {
+            PackingError error;
+            for(const Mesh &mesh : meshes)
+                error.merge(mesh.packingError);
+            float size = glm::length(bounds.max - bounds.min);
+            std::cout << "Model: " << data.path << " packed to " << sizeof(PackedVertex) << "-byte vertices (from "
+                      << sizeof(Vertex) << "), max error: position " << error.position << " (" << error.position / std::max(size, 1e-6f) * 100.0f
+                      << "% of the model's size), normal " << error.normalDegrees << " deg, UV " << error.texCoord << std::endl;
+        }
+    }
 
-// --- UPDATED to handle both file paths and embedded textures from GLB files ---
-unsigned int TextureFromFile(const char *path, const std::string &directory, const aiScene* scene)
-{
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
+    void Draw(Shader &shader, int lod = 0)
+    {
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].Draw(shader, lod);
+    }
 
-    int width, height, nrComponents;
-    unsigned char *data = nullptr;
+    // Level of detail for the whole model (every mesh drawn at the same level, so parts don't come
+    // apart): level i's error is the largest of its meshes'. Meshes with fewer levels use their last one.
+    int selectLod(float pixelsPerUnit, int previous = -1) const
+    {
+        float errors[MAX_MESH_LODS] = {};
+        int count = 1;
+        for(const Mesh &mesh : meshes)
+            count = std::max(count, mesh.lodCount);
+        for(const Mesh &mesh : meshes)
+            for(int i = 0; i < count; i++)
+                errors[i] = std::max(errors[i], mesh.lods[std::min(i, mesh.lodCount - 1)].error);
+        return SelectLod(errors, count, pixelsPerUnit, previous);
+    }
 
-    // Check if the path indicates an embedded texture
-    if (path[0] == '*')
-    {
-        std::cout << "Loading embedded texture: " << path << std::endl;
-        int textureIndex = std::stoi(std::string(path).substr(1));
-        if (textureIndex < scene->mNumTextures) {
-            aiTexture* embeddedTexture = scene->mTextures[textureIndex];
-            // mWidth is the size of the compressed data buffer
-            data = stbi_load_from_memory(reinterpret_cast<unsigned char*>(embeddedTexture->pcData), embeddedTexture->mWidth, &width, &height, &nrComponents, 0);
-        } else {
-             std::cout << "Invalid embedded texture index: " << textureIndex << std::endl;
+    // Radius of a sphere around the model's origin that encloses every mesh (0 while not loaded)
+    float boundingRadius() const
+    {
+        float radius = 0.0f;
+        for(const Mesh &mesh : meshes)
+        {
+            glm::vec3 corner = glm::max(glm::abs(mesh.minAABB), glm::abs(mesh.maxAABB));
+            radius = std::max(radius, glm::length(corner));
         }
+        return radius;
     }
-    else // It's a normal file path
+
+    // GPU memory held by this model's buffers and textures (0 when shared from another model)
+    size_t gpuBytes() const
     {
-        std::string filename = std::string(path);
-        filename = directory + '/' + filename;
-        std::cout << "Attempting to load texture file: " << filename << std::endl;
-        data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
+        if (sharedFrom)
+            return 0;
+        size_t bytes = 0;
+        for(const Mesh &mesh : meshes)
+            bytes += mesh.gpuBytes();
+        for(const Texture &texture : textures_loaded)
+            bytes += texture.bytes;
+        return bytes;
     }
 
-    if (data)
+    // Makes this model a copy of source that shares its GPU geometry and textures (a second file with
+    // the same content). source is kept alive until release(). Must run on the context thread.
+    void shareFrom(std::shared_ptr<Model> source)
     {
-        GLenum format = GL_RGB;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
+        sharedFrom = std::move(source);
+        directory = sharedFrom->directory;
+        meshes = sharedFrom->meshes;
+        textures_loaded = sharedFrom->textures_loaded;
+        for(const Texture &texture : textures_loaded)
+            TextureCache::instance().addReference(texture.key);
+    }
 
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    // The model whose geometry this one shares, if any (see shareFrom)
+    const std::shared_ptr<Model> &sharedSource() const { return sharedFrom; }
 
-        stbi_image_free(data);
-    }
-    else
+    // Frees every GL object the model owns. Must run on the context thread.
+    void release()
     {
-        std::cout << "Texture failed to load for path: " << path << std::endl;
+        if (!sharedFrom)
+            for(Mesh &mesh : meshes)
+                mesh.release();
+        for(Texture &texture : textures_loaded)
+            TextureCache::instance().release(texture.key);
+        meshes.clear();
+        textures_loaded.clear();
+        sharedFrom.reset();
     }
 
-    return textureID;
-}
\ No newline at end of file
+private:
+    std::shared_ptr<Model> sharedFrom;
+};
+
+
+// --- Handles both file paths and embedded textures from GLB files. Runs on job threads (no GL calls). ---
+std::shared_ptr<TextureRecord> DecodeTexture(const std::string &path, const std::string &directory, const std::vector<EmbeddedTexture> &embedded)
+{
+    // Check if the path indicates an embedded texture
+    if (!path.empty() && path[0] == '*')
+    {
+        int textureIndex = std::stoi(path.substr(1));
+        if (textureIndex >= 0 && textureIndex < (int)embedded.size() && embedded[textureIndex].size > 0) {
+            // size is the length of the compressed data buffer
+            return TextureCache::instance().decode(embedded[textureIndex].data, embedded[textureIndex].size, path);
+        }
+        std::cout << "Invalid embedded texture index: " << textureIndex << std::endl;
+        return nullptr;
+    }
+    // It's a normal file path
+    return TextureCache::instance().decodeFile(directory + '/' + path, path);
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include "Model.h"
+#include "JobSystem.h"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <string>
+
+// Handle to a model that is still loading. `model` is usable (but empty) right away and is
+// filled in when the GL upload finishes; `uploaded` becomes ready at that point.
+struct ModelHandle {
+    Model *model = nullptr;
+    std::shared_future<void> uploaded;
+    std::shared_ptr<Model> owner;   // set when the model is shared through ModelRegistry
+
+    bool ready() const
+    {
+        return uploaded.valid() && uploaded.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }
+};
+
+// Two-phase model loader.
+//   CPU phase (JobSystem job):   ModelImporter::load - cache/Assimp parse, vertex conversion, image decode.
+//   GL phase (main-thread job): Model::upload - textures, buffers and VAOs, in batches via uploadFinished().
+class ModelLoader
+{
+public:
+    ModelLoader() = default;
+    ModelLoader(const ModelLoader&) = delete;
+    ModelLoader& operator=(const ModelLoader&) = delete;
+
+    ~ModelLoader() { JobSystem::instance().wait(loads); }
+
+    // Starts loading path into target. target must outlive the load.
+    // adopt, if given, runs on the GL thread once the CPU phase is done (data.sourceHash is known by
+    // then); when it returns true it has filled target itself and the upload is skipped.
+    typedef std::function<bool(ModelData&)> AdoptFn;
+    ModelHandle load(const std::string &path, Model &target, AdoptFn adopt = AdoptFn())
+    {
+        return load(path, target, false, 0, 0, std::move(adopt));
+    }
+
+    // Same, with the source file's hash already known (skips hashing it again on the worker).
+    ModelHandle load(const std::string &path, Model &target, bool hashed, uint64_t sourceHash, uint64_t sourceSize,
+                     AdoptFn adopt = AdoptFn())
+    {
+        std::shared_ptr<PendingModel> job = std::make_shared<PendingModel>();
+        job->path = path;
+        job->target = &target;
+        job->hashed = hashed;
+        job->sourceHash = sourceHash;
+        job->sourceSize = sourceSize;
+        job->adopt = std::move(adopt);
+
+        ModelHandle handle;
+        handle.model = &target;
+        handle.uploaded = job->done.get_future().share();
+
+        inFlight++;
+        JobSystem::instance().run([this, job] {
+            try {
+                job->data = job->hashed ? ModelImporter::load(job->path, true, job->sourceHash, job->sourceSize)
+                                        : ModelImporter::load(job->path);
+            } catch (const std::exception &e) {
+                std::cout << "ERROR::MODELLOADER:: " << job->path << ": " << e.what() << std::endl;
+            }
+            JobSystem::instance().runOnMainThread([this, job] {
+                if (job->adopt && job->adopt(job->data))
+                {
+                    // Shared from another model: the textures decode() pinned aren't needed
+                    for (auto &texture : job->data.textures)
+                        if (texture.second)
+                            TextureCache::instance().unpin(*texture.second);
+                }
+                else
+                {
+                    job->target->upload(job->data);
+                }
+                std::cout << "Loaded " << job->path << " (" << job->target->meshes.size() << " meshes)" << std::endl;
+                job->done.set_value();
+                inFlight--;
+            });
+        }, &loads);
+        return handle;
+    }
+
+    // GL thread only. Uploads models whose CPU phase is done, stopping once budgetMs has been
+    // spent (at least one model is uploaded per call if any is waiting). Returns how many were uploaded.
+    // Also runs any other main-thread jobs queued on the JobSystem.
+    int uploadFinished(double budgetMs = 1.0e9)
+    {
+        return JobSystem::instance().runMainThreadJobs(budgetMs);
+    }
+
+    // GL thread only. Keeps uploading finished models until handle is ready.
+    void waitFor(const ModelHandle &handle)
+    {
+        while (!handle.ready())
+        {
+            if (uploadFinished() == 0)
+                JobSystem::instance().waitForMainThreadJob();
+        }
+    }
+
+    // GL thread only. Blocks until every requested model has been uploaded.
+    void waitAll()
+    {
+        while (inFlight > 0)
+        {
+            if (uploadFinished() == 0)
+                JobSystem::instance().waitForMainThreadJob();
+        }
+    }
+
+    // Models requested but not uploaded yet
+    int pending() const { return inFlight; }
+
+private:
+    struct PendingModel {
+        std::string path;
+        Model *target = nullptr;
+        bool hashed = false;
+        uint64_t sourceHash = 0, sourceSize = 0;
+        AdoptFn adopt;
+        ModelData data;
+        std::promise<void> done;
+    };
+
+    JobCounter loads;               // CPU phases still running
+    std::atomic<int> inFlight{0};
+};
@@ -0,0 +1,157 @@
+#pragma once
+
+#include "Model.h"
+#include "ModelLoader.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Shares one Model (and its geometry/textures) between every request for the same asset.
+// Requests are matched by canonical path right away. The content hash is only known once the load
+// job has read the file on a worker; a file whose content matches a model that is already loaded
+// (a copy under another name) then shares that model's GPU data instead of uploading its own.
+// Handles keep their model alive; purgeUnused() frees models that no handle references anymore.
+class ModelRegistry
+{
+public:
+    explicit ModelRegistry(ModelLoader &loader) : loader(loader) {}
+
+    // Returns a handle to the shared model for path, starting the load on first request.
+    // GL thread only; never touches the file itself.
+    ModelHandle acquire(const std::string &path)
+    {
+        requests++;
+        std::string key = canonicalPath(path);
+
+        auto byPathIt = byPath.find(key);
+        if (byPathIt != byPath.end())
+        {
+            pathHits++;
+            return byPathIt->second->handle;
+        }
+
+        std::shared_ptr<Entry> entry = std::make_shared<Entry>();
+        entry->path = key;
+        entry->model = std::make_shared<Model>();
+        entry->handle = loader.load(path, *entry->model, [this, entry](ModelData &data) { return adopt(entry, data); });
+        entry->handle.owner = entry->model;
+        entries.push_back(entry);
+        byPath[key] = entry;
+        return entry->handle;
+    }
+
+    // GL thread only. Frees models that no handle references anymore (only the registry's own
+    // references are left). Returns how many were freed.
+    int purgeUnused()
+    {
+        int purged = 0;
+        for (size_t i = 0; i < entries.size(); )
+        {
+            std::shared_ptr<Entry> entry = entries[i];
+            if (entry->handle.ready() && liveReferences(*entry) == 0)
+            {
+                std::cout << "ModelRegistry: freeing " << entry->path << std::endl;
+                entry->model->release();
+                for (auto it = byPath.begin(); it != byPath.end(); )
+                    it = it->second == entry ? byPath.erase(it) : std::next(it);
+                for (auto it = byContent.begin(); it != byContent.end(); )
+                    it = it->second == entry ? byContent.erase(it) : std::next(it);
+                entries.erase(entries.begin() + i);
+                purged++;
+                i = 0;  // a freed copy may have been the last thing keeping its source alive
+            }
+            else
+            {
+                i++;
+            }
+        }
+        return purged;
+    }
+
+    // How much loading/memory the sharing saves right now. Sizes are only known once models are uploaded.
+    void printStats() const
+    {
+        size_t uniqueBytes = 0, unsharedBytes = 0;
+        for (const std::shared_ptr<Entry> &entry : entries)
+        {
+            uniqueBytes += entry->model->gpuBytes();
+            unsharedBytes += fullBytes(*entry) * liveReferences(*entry);
+        }
+        size_t savedBytes = unsharedBytes > uniqueBytes ? unsharedBytes - uniqueBytes : 0;
+        std::cout << "ModelRegistry: " << requests << " requests, " << entries.size() << " models ("
+                  << pathHits << " shared by path, " << contentHits << " by content hash), "
+                  << uniqueBytes / (1024 * 1024) << " MB on GPU, "
+                  << savedBytes / (1024 * 1024) << " MB saved by sharing" << std::endl;
+        for (const std::shared_ptr<Entry> &entry : entries)
+        {
+            long references = liveReferences(*entry);
+            if (references > 1 || entry->model->sharedSource())
+                std::cout << "  " << entry->path << ": " << references << " live references, "
+                          << fullBytes(*entry) / 1024 << " KB" << (entry->model->sharedSource() ? " (shared copy)" : "") << std::endl;
+        }
+    }
+
+private:
+    struct Entry {
+        std::string path;
+        std::shared_ptr<Model> model;
+        ModelHandle handle;
+    };
+
+    ModelLoader &loader;
+    std::vector<std::shared_ptr<Entry>> entries;
+    std::map<std::string, std::shared_ptr<Entry>> byPath;
+    std::map<std::pair<uint64_t, uint64_t>, std::shared_ptr<Entry>> byContent;
+    int requests = 0, pathHits = 0, contentHits = 0;
+
+    // Handles (and anything else holding the model) outside the registry. entry.model and
+    // entry.handle.owner are the registry's own two references; copies sharing the model hold one each.
+    long liveReferences(const Entry &entry) const
+    {
+        long references = entry.model.use_count() - 2;
+        for (const std::shared_ptr<Entry> &other : entries)
+            if (other->model->sharedSource() == entry.model)
+                references--;
+        return std::max(references, 0L);
+    }
+
+    static size_t fullBytes(const Entry &entry)
+    {
+        const std::shared_ptr<Model> &source = entry.model->sharedSource();
+        return source ? source->gpuBytes() : entry.model->gpuBytes();
+    }
+
+    // GL thread, once entry's CPU phase is done: share an already loaded model with the same content
+    bool adopt(const std::shared_ptr<Entry> &entry, ModelData &data)
+    {
+        if (!data.hashed)
+            return false;
+        std::pair<uint64_t, uint64_t> key(data.sourceHash, data.sourceSize);
+        auto it = byContent.find(key);
+        if (it == byContent.end())
+        {
+            byContent[key] = entry;
+            return false;
+        }
+        // Two copies still loading at the same time each upload their own
+        const std::shared_ptr<Entry> &source = it->second;
+        if (source == entry || !source->handle.ready() || source->model->meshes.empty())
+            return false;
+        contentHits++;
+        entry->model->shareFrom(source->model);
+        std::cout << "ModelRegistry: " << entry->path << " has the same content as " << source->path << ", sharing it" << std::endl;
+        return true;
+    }
+
+    static std::string canonicalPath(const std::string &path)
+    {
+        std::error_code error;
+        std::filesystem::path canonical = std::filesystem::weakly_canonical(path, error);
+        return error ? path : canonical.generic_string();
+    }
+};
@@ -0,0 +1,210 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "GLStateCache.h"
+#include "InstanceBuffer.h"
+#include "Model.h"
+#include "Shader.h"
+#include "StaticBatch.h"
+#include "UniformBuffer.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+// Passes run in this order; the pass is the most significant part of the sort key
+enum RenderPass {
+    PASS_SHADOW_STATIC = 0,                 // static casters into cascade i's cache (pass PASS_SHADOW_STATIC + i), only when it's stale
+    PASS_SHADOW = SHADOW_CASCADES,          // cascade i (pass PASS_SHADOW + i): copy of its cache plus the dynamic casters
+    PASS_OPAQUE = 2 * SHADOW_CASCADES,      // main camera pass
+    PASS_COUNT
+};
+static_assert(PASS_COUNT <= 16, "RenderPass must fit the 4 pass bits of the sort key");
+
+// One recorded draw: a mesh (optionally instanced) or one material of a StaticBatch, plus the
+// per-draw uniforms it needs.
+// Uniform handles for uniforms the shader doesn't use are harmless (Shader::set ignores them).
+struct DrawItem {
+    static const int MAX_INTS = 2;
+    static const int MAX_VEC3S = 1;
+
+    uint64_t                key = 0;
+    Shader                 *shader = nullptr;
+    Mesh                   *mesh = nullptr;
+    const InstanceBuffer   *instances = nullptr;   // null for a plain draw
+    int                     lod = 0;                // level of detail of mesh
+    StaticBatch            *batch = nullptr;        // instead of mesh: batch->draw(pass, material)
+    int                     material = 0;
+    UniformMat4             modelUniform;
+    glm::mat4               model = glm::mat4(1.0f);
+    int                     intCount = 0;
+    UniformInt              intUniforms[MAX_INTS];
+    int                     intValues[MAX_INTS] = {};
+    int                     vec3Count = 0;
+    UniformVec3             vec3Uniforms[MAX_VEC3S];
+    glm::vec3               vec3Values[MAX_VEC3S];
+
+    DrawItem &setInt(UniformInt uniform, int value)
+    {
+        if (intCount < MAX_INTS)
+        {
+            intUniforms[intCount] = uniform;
+            intValues[intCount++] = value;
+        }
+        return *this;
+    }
+
+    DrawItem &setVec3(UniformVec3 uniform, const glm::vec3 &value)
+    {
+        if (vec3Count < MAX_VEC3S)
+        {
+            vec3Uniforms[vec3Count] = uniform;
+            vec3Values[vec3Count++] = value;
+        }
+        return *this;
+    }
+};
+
+// Collects a frame's draws, sorts them by a 64-bit key and submits them through GLStateCache.
+// Key layout, most significant first:
+//   pass (4 bits) | program (8) | diffuse texture (16) | VAO (16) | view depth (20, front to back)
+// so each pass runs in one go, and within it draws sharing a program/texture/VAO end up adjacent.
+// GL names are truncated to their field width, which can only cost grouping, never correctness.
+class RenderQueue
+{
+public:
+    static constexpr float MAX_DEPTH = 5000.0f;    // camera far plane; depths beyond it share the last bucket
+
+    // Starts a new frame. viewPos is used for the depth part of the key.
+    void begin(const glm::vec3 &viewPos)
+    {
+        items.clear();
+        this->viewPos = viewPos;
+    }
+
+    DrawItem &draw(RenderPass pass, Shader &shader, Mesh &mesh, UniformMat4 modelUniform, const glm::mat4 &model, int lod = 0)
+    {
+        items.emplace_back();
+        DrawItem &item = items.back();
+        item.shader = &shader;
+        item.mesh = &mesh;
+        item.lod = lod;
+        item.modelUniform = modelUniform;
+        item.model = model;
+        item.key = makeKey(pass, shader.ID, mesh.diffuseTexture(), mesh.VAO, glm::length(glm::vec3(model[3]) - viewPos));
+        return item;
+    }
+
+    // Every instance in `instances`, one GL draw. Depth is left at 0 since instances are spread out.
+    DrawItem &drawInstanced(RenderPass pass, Shader &shader, Mesh &mesh, const InstanceBuffer &instances, int lod = 0)
+    {
+        items.emplace_back();
+        DrawItem &item = items.back();
+        item.shader = &shader;
+        item.mesh = &mesh;
+        item.lod = lod;
+        item.instances = &instances;
+        item.key = makeKey(pass, shader.ID, mesh.diffuseTexture(), mesh.VAO, 0.0f);
+        return item;
+    }
+
+    // Every material of batch that has ranges in pass (see StaticBatch::add), one multi-draw each
+    void drawBatch(RenderPass pass, Shader &shader, StaticBatch &batch, UniformMat4 modelUniform, const glm::mat4 &model)
+    {
+        for (int material = 0; material < (int)batch.materials.size(); material++)
+        {
+            if (batch.rangesOf(pass, material).empty())
+                continue;
+            items.emplace_back();
+            DrawItem &item = items.back();
+            item.shader = &shader;
+            item.batch = &batch;
+            item.material = material;
+            item.modelUniform = modelUniform;
+            item.model = model;
+            const StaticBatch::Material &m = batch.materials[material];
+            item.key = makeKey(pass, shader.ID, m.texture, m.VAO, 0.0f);
+        }
+    }
+
+    // Convenience: every mesh of model with the same transform
+    void drawModel(RenderPass pass, Shader &shader, Model &model, UniformMat4 modelUniform, const glm::mat4 &matrix, int lod = 0)
+    {
+        for (Mesh &mesh : model.meshes)
+            draw(pass, shader, mesh, modelUniform, matrix, lod);
+    }
+
+    // Sorts and submits everything recorded since begin(). beginPass is called before the first
+    // draw of each pass (and for passes with no draws, so their targets still get cleared).
+    void execute(const std::function<void(RenderPass)> &beginPass)
+    {
+        order.clear();
+        order.reserve(items.size());
+        for (size_t i = 0; i < items.size(); i++)
+            order.emplace_back(items[i].key, (uint32_t)i);
+        std::sort(order.begin(), order.end());
+
+        int pass = -1;
+        for (const auto &entry : order)
+        {
+            const DrawItem &item = items[entry.second];
+            int itemPass = (int)(item.key >> PASS_SHIFT);
+            while (pass < itemPass)
+                beginPass((RenderPass)++pass);
+
+            Shader &shader = *item.shader;
+            shader.use();
+            for (int i = 0; i < item.intCount; i++)
+                shader.set(item.intUniforms[i], item.intValues[i]);
+            for (int i = 0; i < item.vec3Count; i++)
+                shader.set(item.vec3Uniforms[i], item.vec3Values[i]);
+            if (item.batch)
+            {
+                shader.set(item.modelUniform, item.model);
+                item.batch->draw(shader, itemPass, item.material);
+            }
+            else if (item.instances)
+            {
+                item.mesh->DrawInstanced(shader, *item.instances, item.lod);
+            }
+            else
+            {
+                shader.set(item.modelUniform, item.model);
+                item.mesh->Draw(shader, item.lod);
+            }
+        }
+        while (pass < PASS_OPAQUE)
+            beginPass((RenderPass)++pass);
+    }
+
+    size_t size() const { return items.size(); }
+
+    static uint64_t makeKey(RenderPass pass, unsigned int program, unsigned int texture, unsigned int vao, float depth)
+    {
+        return ((uint64_t)pass << PASS_SHIFT)
+             | ((uint64_t)(program & 0xFFu) << PROGRAM_SHIFT)
+             | ((uint64_t)(texture & 0xFFFFu) << TEXTURE_SHIFT)
+             | ((uint64_t)(vao & 0xFFFFu) << VAO_SHIFT)
+             | (uint64_t)quantizeDepth(depth);
+    }
+
+private:
+    static const int PASS_SHIFT = 60;
+    static const int PROGRAM_SHIFT = 52;
+    static const int TEXTURE_SHIFT = 36;
+    static const int VAO_SHIFT = 20;
+    static const uint32_t DEPTH_MASK = (1u << VAO_SHIFT) - 1;
+
+    std::vector<DrawItem> items;
+    std::vector<std::pair<uint64_t, uint32_t>> order;   // (key, item index), sorted each frame
+    glm::vec3 viewPos = glm::vec3(0.0f);
+
+    static uint32_t quantizeDepth(float depth)
+    {
+        float t = depth / MAX_DEPTH;
+        return (uint32_t)(glm::clamp(t, 0.0f, 1.0f) * DEPTH_MASK);
+    }
+};
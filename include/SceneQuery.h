@@ -0,0 +1,430 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "BVH.h"
+#include "JobSystem.h"
+#include "SpatialHash.h"
+
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SCENE_QUERY_SSE 1
+#endif
+
+// What a query can hit
+enum SceneQueryMask {
+    QUERY_STATIC  = 1,  // the static BVH (the city)
+    QUERY_DYNAMIC = 2   // the dynamic spheres (aircraft)
+};
+
+// A ray (radius 0) or a sphere of `radius` swept from origin along direction, up to maxDistance.
+struct SceneRay {
+    glm::vec3    origin;
+    glm::vec3    direction;     // normalized
+    float        maxDistance = 0.0f;
+    float        radius = 0.0f;
+    unsigned int mask = QUERY_STATIC | QUERY_DYNAMIC;
+};
+
+// First contact along a SceneRay. For sweeps, point is the sphere's center at contact.
+struct SceneHit {
+    bool      hit = false;
+    float     distance = 0.0f;
+    glm::vec3 point = glm::vec3(0.0f);
+    glm::vec3 normal = glm::vec3(0.0f);
+    int       body = -1;        // index of the dynamic sphere hit, -1 for static geometry
+};
+
+// "What does this ray or moving sphere hit first?" against the static city BVH and a set of
+// dynamic spheres. castBatch takes a whole frame's queries at once and walks the BVH with packets
+// of four rays (SSE): a node is fetched once per packet and its box tested against all four lanes.
+// The dynamic spheres go into a SpatialHash, rebuilt on the first query after they change, so each
+// query only tests the spheres in the cells its path crosses. A large batch is split into ranges of
+// packets that run as JobSystem jobs; the BVH and grid are only read during the batch.
+class SceneQuery
+{
+public:
+    // Per-batch counters, for profiling
+    unsigned int raysCast = 0;
+    unsigned int packetsCast = 0;
+    unsigned int nodesVisited = 0;
+    unsigned int dynamicCandidates = 0;    // spheres the broadphase handed to the narrowphase
+
+    void setStatic(const BVH *bvh) { staticBVH = bvh; }
+
+    void clearDynamic() { bodies.clear(); gridDirty = true; }
+    // Returns the body's index, which SceneHit::body refers to
+    int addDynamic(const glm::vec3 &center, float radius)
+    {
+        bodies.push_back(glm::vec4(center, radius));
+        gridDirty = true;
+        return (int)bodies.size() - 1;
+    }
+
+    SceneHit cast(const SceneRay &ray)
+    {
+        SceneHit hit;
+        Counters counters;
+        updateGrid();
+        castPacket(&ray, 1, &hit, counters);
+        addCounters(counters);
+        return hit;
+    }
+
+    void castBatch(const std::vector<SceneRay> &rays, std::vector<SceneHit> &hits)
+    {
+        raysCast = packetsCast = nodesVisited = dynamicCandidates = 0;
+        hits.assign(rays.size(), SceneHit());
+        updateGrid();
+        std::mutex countersMutex;
+        uint32_t packets = (uint32_t)((rays.size() + PACKET_SIZE - 1) / PACKET_SIZE);
+        JobSystem::instance().parallelFor(packets, PACKETS_PER_JOB, [&](uint32_t begin, uint32_t end) {
+            Counters counters;
+            for (uint32_t p = begin; p < end; p++)
+            {
+                size_t i = (size_t)p * PACKET_SIZE;
+                castPacket(&rays[i], (int)std::min<size_t>(PACKET_SIZE, rays.size() - i), &hits[i], counters);
+            }
+            std::lock_guard<std::mutex> lock(countersMutex);
+            addCounters(counters);
+        });
+    }
+
+    // --- Narrowphase, also usable on its own. distance is in/out: only hits closer than it count. ---
+
+    // Möller-Trumbore ray/triangle
+    static bool rayTriangle(const glm::vec3 &origin, const glm::vec3 &direction, const BVHTriangle &t,
+                            float &distance, glm::vec3 &normal)
+    {
+        glm::vec3 e1 = t.v1 - t.v0, e2 = t.v2 - t.v0;
+        glm::vec3 p = glm::cross(direction, e2);
+        float det = glm::dot(e1, p);
+        if (std::fabs(det) < 1e-12f)
+            return false;
+        float invDet = 1.0f / det;
+        glm::vec3 s = origin - t.v0;
+        float u = glm::dot(s, p) * invDet;
+        if (u < 0.0f || u > 1.0f)
+            return false;
+        glm::vec3 q = glm::cross(s, e1);
+        float v = glm::dot(direction, q) * invDet;
+        if (v < 0.0f || u + v > 1.0f)
+            return false;
+        float d = glm::dot(e2, q) * invDet;
+        if (d < 0.0f || d >= distance)
+            return false;
+        distance = d;
+        normal = glm::normalize(glm::cross(e1, e2));
+        if (glm::dot(normal, direction) > 0.0f)
+            normal = -normal;
+        return true;
+    }
+
+    // Ray/sphere, starting inside counts as a hit at 0
+    static bool raySphere(const glm::vec3 &origin, const glm::vec3 &direction, const glm::vec3 &center, float radius,
+                          float &distance, glm::vec3 &normal)
+    {
+        glm::vec3 oc = origin - center;
+        float c = glm::dot(oc, oc) - radius * radius;
+        float d;
+        if (c <= 0.0f)
+        {
+            d = 0.0f;
+        }
+        else
+        {
+            float b = glm::dot(oc, direction);
+            float disc = b * b - c;
+            if (b > 0.0f || disc < 0.0f)
+                return false;
+            d = -b - std::sqrt(disc);
+        }
+        if (d >= distance)
+            return false;
+        distance = d;
+        glm::vec3 offset = origin + direction * d - center;
+        float length = glm::length(offset);
+        normal = length > 0.0f ? offset / length : -direction;
+        return true;
+    }
+
+    // Sphere of radius swept along the ray vs triangle: the ray against the triangle grown by radius,
+    // i.e. the face pushed out along its normal, a cylinder around each edge and a sphere on each vertex.
+    static bool sweptSphereTriangle(const glm::vec3 &origin, const glm::vec3 &direction, float radius, const BVHTriangle &t,
+                                    float &distance, glm::vec3 &normal)
+    {
+        // Already touching
+        glm::vec3 closest = ClosestPointOnTriangle(origin, t.v0, t.v1, t.v2);
+        glm::vec3 offset = origin - closest;
+        float offsetSq = glm::dot(offset, offset);
+        if (offsetSq <= radius * radius)
+        {
+            if (distance <= 0.0f)
+                return false;
+            distance = 0.0f;
+            normal = offsetSq > 0.0f ? offset / std::sqrt(offsetSq) : -direction;
+            return true;
+        }
+
+        glm::vec3 e1 = t.v1 - t.v0, e2 = t.v2 - t.v0;
+        glm::vec3 faceNormal = glm::cross(e1, e2);
+        float area = glm::length(faceNormal);
+        if (area > 0.0f)
+        {
+            // Face: the first contact, when it falls inside the triangle
+            faceNormal /= area;
+            float side = glm::dot(origin - t.v0, faceNormal);
+            if (side < 0.0f) { faceNormal = -faceNormal; side = -side; }
+            float approach = glm::dot(direction, faceNormal);
+            if (approach < 0.0f)
+            {
+                float d = (side - radius) / -approach;
+                if (d >= 0.0f && d < distance)
+                {
+                    glm::vec3 contact = origin + direction * d - faceNormal * radius;
+                    if (insideTriangle(contact, t.v0, e1, e2))
+                    {
+                        distance = d;
+                        normal = faceNormal;
+                        return true;
+                    }
+                }
+            }
+        }
+
+        bool found = false;
+        const glm::vec3 *corners[3] = { &t.v0, &t.v1, &t.v2 };
+        for (int i = 0; i < 3; i++)
+        {
+            found |= rayCylinder(origin, direction, *corners[i], *corners[(i + 1) % 3], radius, distance, normal);
+            found |= raySphere(origin, direction, *corners[i], radius, distance, normal);
+        }
+        return found;
+    }
+
+private:
+    static const int PACKET_SIZE = 4;
+
+    static const uint32_t PACKETS_PER_JOB = 16;
+
+    struct Counters {
+        unsigned int raysCast = 0, packetsCast = 0, nodesVisited = 0, dynamicCandidates = 0;
+    };
+
+    const BVH *staticBVH = nullptr;
+    std::vector<glm::vec4> bodies;  // xyz = center, w = radius
+    SpatialHash grid;
+    bool gridDirty = false;
+
+    void updateGrid()
+    {
+        if (!gridDirty)
+            return;
+        // Cells twice the largest radius: a short path touches only a handful of them
+        float maxRadius = 0.0f;
+        for (const glm::vec4 &body : bodies)
+            maxRadius = std::max(maxRadius, body.w);
+        grid.build(bodies, 2.0f * maxRadius);
+        gridDirty = false;
+    }
+
+    void addCounters(const Counters &counters)
+    {
+        raysCast += counters.raysCast;
+        packetsCast += counters.packetsCast;
+        nodesVisited += counters.nodesVisited;
+        dynamicCandidates += counters.dynamicCandidates;
+    }
+
+    static bool insideTriangle(const glm::vec3 &p, const glm::vec3 &v0, const glm::vec3 &e1, const glm::vec3 &e2)
+    {
+        glm::vec3 v0p = p - v0;
+        float d00 = glm::dot(e1, e1), d01 = glm::dot(e1, e2), d11 = glm::dot(e2, e2);
+        float d20 = glm::dot(v0p, e1), d21 = glm::dot(v0p, e2);
+        float denom = d00 * d11 - d01 * d01;
+        if (denom == 0.0f)
+            return false;
+        float v = (d11 * d20 - d01 * d21) / denom;
+        float w = (d00 * d21 - d01 * d20) / denom;
+        return v >= 0.0f && w >= 0.0f && v + w <= 1.0f;
+    }
+
+    // Ray vs the finite cylinder of radius around segment ab (caps excluded; the vertex spheres cover them)
+    static bool rayCylinder(const glm::vec3 &origin, const glm::vec3 &direction, const glm::vec3 &a, const glm::vec3 &b,
+                            float radius, float &distance, glm::vec3 &normal)
+    {
+        glm::vec3 ab = b - a, ao = origin - a;
+        float abab = glm::dot(ab, ab);
+        float abd = glm::dot(ab, direction), abao = glm::dot(ab, ao);
+        float qa = abab - abd * abd;                   // direction is unit length
+        if (qa <= 1e-9f * abab)
+            return false;                              // parallel to the edge
+        float qb = abab * glm::dot(ao, direction) - abao * abd;
+        float qc = abab * (glm::dot(ao, ao) - radius * radius) - abao * abao;
+        float disc = qb * qb - qa * qc;
+        if (disc < 0.0f)
+            return false;
+        float d = (-qb - std::sqrt(disc)) / qa;
+        if (d < 0.0f || d >= distance)
+            return false;
+        float s = (abao + d * abd) / abab;
+        if (s < 0.0f || s > 1.0f)
+            return false;
+        distance = d;
+        glm::vec3 offset = origin + direction * d - (a + ab * s);
+        float length = glm::length(offset);
+        normal = length > 0.0f ? offset / length : -direction;
+        return true;
+    }
+
+    static bool leafTest(const SceneRay &ray, const BVHTriangle &t, float &distance, glm::vec3 &normal)
+    {
+        return ray.radius > 0.0f ? sweptSphereTriangle(ray.origin, ray.direction, ray.radius, t, distance, normal)
+                                 : rayTriangle(ray.origin, ray.direction, t, distance, normal);
+    }
+
+    // Lanes (bit per ray) of the packet whose ray/sweep reaches node's box before its current best hit
+    struct Packet {
+        float originX[PACKET_SIZE], originY[PACKET_SIZE], originZ[PACKET_SIZE];
+        float inverseX[PACKET_SIZE], inverseY[PACKET_SIZE], inverseZ[PACKET_SIZE];
+        float radius[PACKET_SIZE], best[PACKET_SIZE];
+    };
+
+    static unsigned int nodeMask(const BVHNode &node, const Packet &packet, unsigned int active)
+    {
+#ifdef SCENE_QUERY_SSE
+        __m128 radius = _mm_loadu_ps(packet.radius);
+        __m128 t1x = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(_mm_set1_ps(node.minAABB.x), radius), _mm_loadu_ps(packet.originX)), _mm_loadu_ps(packet.inverseX));
+        __m128 t2x = _mm_mul_ps(_mm_sub_ps(_mm_add_ps(_mm_set1_ps(node.maxAABB.x), radius), _mm_loadu_ps(packet.originX)), _mm_loadu_ps(packet.inverseX));
+        __m128 t1y = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(_mm_set1_ps(node.minAABB.y), radius), _mm_loadu_ps(packet.originY)), _mm_loadu_ps(packet.inverseY));
+        __m128 t2y = _mm_mul_ps(_mm_sub_ps(_mm_add_ps(_mm_set1_ps(node.maxAABB.y), radius), _mm_loadu_ps(packet.originY)), _mm_loadu_ps(packet.inverseY));
+        __m128 t1z = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(_mm_set1_ps(node.minAABB.z), radius), _mm_loadu_ps(packet.originZ)), _mm_loadu_ps(packet.inverseZ));
+        __m128 t2z = _mm_mul_ps(_mm_sub_ps(_mm_add_ps(_mm_set1_ps(node.maxAABB.z), radius), _mm_loadu_ps(packet.originZ)), _mm_loadu_ps(packet.inverseZ));
+        __m128 tNear = _mm_max_ps(_mm_max_ps(_mm_min_ps(t1x, t2x), _mm_min_ps(t1y, t2y)), _mm_max_ps(_mm_min_ps(t1z, t2z), _mm_setzero_ps()));
+        __m128 tFar = _mm_min_ps(_mm_min_ps(_mm_max_ps(t1x, t2x), _mm_max_ps(t1y, t2y)), _mm_min_ps(_mm_max_ps(t1z, t2z), _mm_loadu_ps(packet.best)));
+        return (unsigned int)_mm_movemask_ps(_mm_cmple_ps(tNear, tFar)) & active;
+#else
+        unsigned int mask = 0;
+        for (int lane = 0; lane < PACKET_SIZE; lane++)
+        {
+            if (!(active & (1u << lane)))
+                continue;
+            float r = packet.radius[lane];
+            float t1x = (node.minAABB.x - r - packet.originX[lane]) * packet.inverseX[lane];
+            float t2x = (node.maxAABB.x + r - packet.originX[lane]) * packet.inverseX[lane];
+            float t1y = (node.minAABB.y - r - packet.originY[lane]) * packet.inverseY[lane];
+            float t2y = (node.maxAABB.y + r - packet.originY[lane]) * packet.inverseY[lane];
+            float t1z = (node.minAABB.z - r - packet.originZ[lane]) * packet.inverseZ[lane];
+            float t2z = (node.maxAABB.z + r - packet.originZ[lane]) * packet.inverseZ[lane];
+            float tNear = std::max(std::max(std::min(t1x, t2x), std::min(t1y, t2y)), std::max(std::min(t1z, t2z), 0.0f));
+            float tFar = std::min(std::min(std::max(t1x, t2x), std::max(t1y, t2y)), std::min(std::max(t1z, t2z), packet.best[lane]));
+            if (tNear <= tFar)
+                mask |= 1u << lane;
+        }
+        return mask;
+#endif
+    }
+
+    static float safeInverse(float d)
+    {
+        // Keeps 0 * inverse finite for axis-parallel rays (the slab test then degenerates correctly)
+        return 1.0f / (std::fabs(d) > 1e-30f ? d : (d < 0.0f ? -1e-30f : 1e-30f));
+    }
+
+    // Reads only the BVH, bodies and grid (call updateGrid first), so packets can run concurrently
+    void castPacket(const SceneRay *rays, int count, SceneHit *hits, Counters &counters) const
+    {
+        counters.raysCast += count;
+        counters.packetsCast++;
+
+        Packet packet;
+        unsigned int active = 0;
+        for (int lane = 0; lane < PACKET_SIZE; lane++)
+        {
+            // Unused lanes get a ray that can't hit anything and stay out of `active`
+            const SceneRay *ray = lane < count ? &rays[lane] : nullptr;
+            glm::vec3 origin = ray ? ray->origin : glm::vec3(0.0f);
+            glm::vec3 direction = ray ? ray->direction : glm::vec3(1.0f, 0.0f, 0.0f);
+            packet.originX[lane] = origin.x;
+            packet.originY[lane] = origin.y;
+            packet.originZ[lane] = origin.z;
+            packet.inverseX[lane] = safeInverse(direction.x);
+            packet.inverseY[lane] = safeInverse(direction.y);
+            packet.inverseZ[lane] = safeInverse(direction.z);
+            packet.radius[lane] = ray ? ray->radius : 0.0f;
+            packet.best[lane] = ray ? ray->maxDistance : 0.0f;
+            if (ray && (ray->mask & QUERY_STATIC) && ray->maxDistance > 0.0f)
+                active |= 1u << lane;
+        }
+
+        if (staticBVH && !staticBVH->empty() && active)
+        {
+            uint32_t stack[BVH::MAX_DEPTH + 1];
+            int top = 0;
+            stack[top++] = 0;
+            while (top > 0)
+            {
+                const BVHNode &node = staticBVH->nodes[stack[--top]];
+                counters.nodesVisited++;
+                unsigned int mask = nodeMask(node, packet, active);
+                if (!mask)
+                    continue;
+                if (node.count == 0)
+                {
+                    stack[top++] = node.leftFirst + 1;
+                    stack[top++] = node.leftFirst;
+                    continue;
+                }
+                for (int lane = 0; lane < count; lane++)
+                {
+                    if (!(mask & (1u << lane)))
+                        continue;
+                    for (uint32_t i = node.leftFirst; i < node.leftFirst + node.count; i++)
+                    {
+                        if (leafTest(rays[lane], staticBVH->triangles[i], packet.best[lane], hits[lane].normal))
+                        {
+                            hits[lane].hit = true;
+                            hits[lane].body = -1;
+                        }
+                    }
+                }
+            }
+        }
+
+        for (int lane = 0; lane < count; lane++)
+        {
+            const SceneRay &ray = rays[lane];
+            if ((ray.mask & QUERY_DYNAMIC) && !bodies.empty())
+            {
+                // Broadphase: cells around the path so far. Then a squared-distance check against the
+                // path segment before the exact ray/sphere test.
+                glm::vec3 start = ray.origin, end = ray.origin + ray.direction * packet.best[lane];
+                glm::vec3 pad(ray.radius);
+                grid.query(glm::min(start, end) - pad, glm::max(start, end) + pad, [&](uint32_t b) {
+                    counters.dynamicCandidates++;
+                    glm::vec3 center(bodies[b]);
+                    float reach = bodies[b].w + ray.radius;
+                    float along = glm::clamp(glm::dot(center - ray.origin, ray.direction), 0.0f, packet.best[lane]);
+                    glm::vec3 offset = ray.origin + ray.direction * along - center;
+                    if (glm::dot(offset, offset) > reach * reach)
+                        return;
+                    if (raySphere(ray.origin, ray.direction, center, reach, packet.best[lane], hits[lane].normal))
+                    {
+                        hits[lane].hit = true;
+                        hits[lane].body = (int)b;
+                    }
+                });
+            }
+            if (hits[lane].hit)
+            {
+                hits[lane].distance = packet.best[lane];
+                hits[lane].point = ray.origin + ray.direction * packet.best[lane];
+            }
+        }
+    }
+};
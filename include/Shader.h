@@ -3,15 +3,39 @@
 
 #include <glad/glad.h>
 #include <glm/glm.hpp>
+#include "GLStateCache.h"
+#include "UniformBuffer.h"
+#include <cstring>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <unordered_map>
+#include <vector>
+
+// Typed handle to an active uniform of one Shader. Resolve once (Shader::uniformMat4 etc.) and
+// pass to Shader::set on the hot path: no string building, no glGetUniformLocation.
+// A handle for a uniform the program doesn't use is valid but does nothing.
+template <typename T>
+struct UniformHandle {
+    int index = -1;
+};
+typedef UniformHandle<int>       UniformInt;
+typedef UniformHandle<float>     UniformFloat;
+typedef UniformHandle<glm::vec3> UniformVec3;
+typedef UniformHandle<glm::mat4> UniformMat4;
 
 class Shader {
 public:
     unsigned int ID;
 
+    // Uploads that actually reached GL vs. ones skipped because the value was unchanged
+    mutable unsigned int uniformUploads = 0;
+    mutable unsigned int uniformUploadsSkipped = 0;
+
+    // Dequantization of packed mesh positions (Mesh::setPositionDequantization); no-ops if unused
+    UniformVec3 positionOffset, positionScale;
+
     Shader(const char* vertexPath, const char* fragmentPath) {
         std::string vertexCode;
         std::string fragmentCode;
@@ -32,6 +56,7 @@ public:
         } catch (std::ifstream::failure& e) {
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ" << std::endl;
         }
+        vertexCode = withPackedVertexCode(vertexCode, vertexPath);
         const char* vShaderCode = vertexCode.c_str();
         const char * fShaderCode = fragmentCode.c_str();
         unsigned int vertex, fragment;
@@ -54,31 +79,151 @@ public:
 
         glDeleteShader(vertex);
         glDeleteShader(fragment);
+
+        reflectUniforms();
+        positionOffset = uniformVec3("positionOffset");
+        positionScale = uniformVec3("positionScale");
+        bindUniformBlock("FrameData", FRAME_UNIFORM_BINDING, sizeof(FrameUniformData));
+        bindUniformBlock("PassData", PASS_UNIFORM_BINDING, sizeof(PassUniformData));
+        bindUniformBlock("ShadowData", SHADOW_UNIFORM_BINDING, sizeof(ShadowUniformData));
     }
     
     void use() { 
-        glUseProgram(ID); 
+        GLStateCache::instance().useProgram(ID); 
     }
     
+    UniformInt   uniformInt(const std::string &name) const   { return UniformInt{ findUniform(name) }; }
+    UniformFloat uniformFloat(const std::string &name) const { return UniformFloat{ findUniform(name) }; }
+    UniformVec3  uniformVec3(const std::string &name) const  { return UniformVec3{ findUniform(name) }; }
+    UniformMat4  uniformMat4(const std::string &name) const  { return UniformMat4{ findUniform(name) }; }
+
+    // The shader must be in use. Values equal to the last one uploaded are skipped.
+    void set(UniformMat4 u, const glm::mat4 &mat) const {
+        if (changed(u.index, &mat[0][0], sizeof(glm::mat4)))
+            glUniformMatrix4fv(uniforms[u.index].location, 1, GL_FALSE, &mat[0][0]);
+    }
+    void set(UniformInt u, int value) const {
+        if (changed(u.index, &value, sizeof(int)))
+            glUniform1i(uniforms[u.index].location, value);
+    }
+    void set(UniformVec3 u, const glm::vec3 &value) const {
+        if (changed(u.index, &value[0], sizeof(glm::vec3)))
+            glUniform3fv(uniforms[u.index].location, 1, &value[0]);
+    }
+    void set(UniformFloat u, float value) const {
+        if (changed(u.index, &value, sizeof(float)))
+            glUniform1f(uniforms[u.index].location, value);
+    }
+
+    // Name-based setters, for one-off uniforms. They go through the same table and value cache.
     void setMat4(const std::string &name, const glm::mat4 &mat) const {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        set(uniformMat4(name), mat);
     }
 
     void setInt(const std::string &name, int value) const {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+        set(uniformInt(name), value);
     }
 
     void setVec3(const std::string &name, float x, float y, float z) const { 
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z); 
+        set(uniformVec3(name), glm::vec3(x, y, z));
     }
     void setVec3(const std::string &name, const glm::vec3 &value) const { 
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        set(uniformVec3(name), value);
     }
     void setFloat(const std::string &name, float value) const{
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+        set(uniformFloat(name), value);
     }
 
 private:
+    struct ActiveUniform {
+        GLint location;
+        GLenum type;
+        bool hasValue;
+        unsigned char value[sizeof(glm::mat4)];   // CPU shadow of the last upload
+    };
+    mutable std::vector<ActiveUniform> uniforms;
+    std::unordered_map<std::string, int> uniformIndex;
+
+    // Builds the name -> uniform table from the linked program (glGetActiveUniform).
+    void reflectUniforms() {
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<char> nameBuffer(maxLength > 0 ? maxLength : 1);
+        for (GLint i = 0; i < count; i++) {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(ID, (GLuint)i, (GLsizei)nameBuffer.size(), &length, &size, &type, nameBuffer.data());
+            std::string name(nameBuffer.data(), length);
+            GLint location = glGetUniformLocation(ID, name.c_str());
+            if (location < 0)
+                continue; // lives in a uniform block
+            if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+                name.erase(name.size() - 3); // arrays are reported as "name[0]"
+
+            ActiveUniform uniform;
+            uniform.location = location;
+            uniform.type = type;
+            uniform.hasValue = false;
+            uniformIndex[name] = (int)uniforms.size();
+            uniforms.push_back(uniform);
+        }
+    }
+
+    // Inserts packed_vertex.glsl (from the vertex shader's directory) right after the #version line.
+    // The #line directive keeps compile errors pointing at the vertex shader's own line numbers.
+    static std::string withPackedVertexCode(const std::string &code, const std::string &vertexPath) {
+        std::string directory = vertexPath.substr(0, vertexPath.find_last_of("/\\") + 1);
+        std::ifstream snippetFile(directory + "packed_vertex.glsl");
+        if (!snippetFile) {
+            std::cout << "ERROR::SHADER::PACKED_VERTEX_SNIPPET_NOT_FOUND " << directory << "packed_vertex.glsl" << std::endl;
+            return code;
+        }
+        std::stringstream snippet;
+        snippet << snippetFile.rdbuf();
+
+        size_t version = code.find("#version");
+        size_t versionEnd = version == std::string::npos ? version : code.find('\n', version);
+        if (versionEnd == std::string::npos)
+            return code;
+        return code.substr(0, versionEnd + 1) + snippet.str() + "\n#line 2\n" + code.substr(versionEnd + 1);
+    }
+
+    // GLSL 330 has no layout(binding = N), so shared blocks are attached to their binding point here.
+    // The size check catches a std140 struct that drifted out of sync with the GLSL block.
+    void bindUniformBlock(const char *name, unsigned int binding, size_t expectedSize) {
+        GLuint block = glGetUniformBlockIndex(ID, name);
+        if (block == GL_INVALID_INDEX)
+            return; // this program doesn't use the block
+        GLint size = 0;
+        glGetActiveUniformBlockiv(ID, block, GL_UNIFORM_BLOCK_DATA_SIZE, &size);
+        if ((size_t)size != expectedSize)
+            std::cout << "ERROR::SHADER::UNIFORM_BLOCK_SIZE_MISMATCH " << name << ": " << size << " bytes in GLSL, "
+                      << expectedSize << " bytes in C++" << std::endl;
+        glUniformBlockBinding(ID, block, binding);
+    }
+
+    int findUniform(const std::string &name) const {
+        auto it = uniformIndex.find(name);
+        return it == uniformIndex.end() ? -1 : it->second;
+    }
+
+    // True (and updates the shadow) if value differs from what the uniform last received.
+    bool changed(int index, const void *value, size_t size) const {
+        if (index < 0)
+            return false;
+        ActiveUniform &uniform = uniforms[index];
+        if (uniform.hasValue && std::memcmp(uniform.value, value, size) == 0) {
+            uniformUploadsSkipped++;
+            return false;
+        }
+        std::memcpy(uniform.value, value, size);
+        uniform.hasValue = true;
+        uniformUploads++;
+        return true;
+    }
+
     void checkCompileErrors(unsigned int shader, std::string type) {
         int success;
         char infoLog[1024];
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "Frustum.h"
+#include "GLStateCache.h"
+#include "UniformBuffer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+// Cascaded shadow map for the sun. The camera's view range is cut into SHADOW_CASCADES slices,
+// each given its own orthographic shadow map (one layer of a depth texture array), so nearby
+// shadows get fine texels while the far city still falls inside some cascade.
+//
+// Each slice is wrapped in a bounding sphere whose size only depends on the projection, and the
+// cascade is a box cacheMargin larger than that sphere, snapped to whole shadow texels in light
+// space. The box stays put until the sphere leaves it (or the sun has turned by more than
+// refreshAngle), so moving the camera neither resamples the scene (no shimmering edges) nor
+// changes what the static casters put into the cascade. The depth range reaches casterDistance
+// towards the sun past the box, for casters outside the view that still shadow it.
+//
+// Static casters (the city) are drawn into staticArray only when their cascade has moved
+// (staticDirty); every frame each cascade starts as a copy of that cache and only the dynamic
+// casters are drawn on top of it.
+class ShadowCascades
+{
+public:
+    unsigned int resolution = 0;
+    unsigned int depthArray = 0;                        // GL_TEXTURE_2D_ARRAY, one layer per cascade: what the main pass samples
+    unsigned int framebuffers[SHADOW_CASCADES] = {};    // framebuffers[i] renders into layer i
+    unsigned int staticArray = 0;                       // cached depth of the static casters, same layout
+    unsigned int staticFramebuffers[SHADOW_CASCADES] = {};
+
+    float splitLambda = 0.8f;       // 0 = uniform splits, 1 = logarithmic
+    float casterDistance = 1500.0f; // world units towards the sun that casters are still looked for
+    float depthBiasTexels = 2.0f;   // comparison bias, in shadow texels of the cascade
+    float cacheMargin = 0.2f;       // box half-size = (1 + cacheMargin) * slice radius; more = fewer static redraws, coarser texels
+    float refreshAngle = 0.5f;      // degrees the sun may turn before the static casters are redrawn
+
+    // Updated by update()
+    glm::mat4 matrices[SHADOW_CASCADES];    // world -> light clip space
+    Frustum frustums[SHADOW_CASCADES];      // of matrices[i], for culling casters
+    float splits[SHADOW_CASCADES];          // far view distance of each cascade
+    float texelSize[SHADOW_CASCADES];       // world units per shadow texel
+    float depthRange[SHADOW_CASCADES];      // world units between the near and far plane
+    bool staticDirty[SHADOW_CASCADES] = {}; // static casters must be redrawn into this cascade's cache
+    int staticRefreshes = 0;                // cascades whose cache is redrawn this frame
+
+    ShadowCascades() = default;
+    ShadowCascades(const ShadowCascades&) = delete;
+    ShadowCascades& operator=(const ShadowCascades&) = delete;
+
+    ~ShadowCascades()
+    {
+        if (depthArray)
+        {
+            glDeleteFramebuffers(SHADOW_CASCADES, framebuffers);
+            glDeleteFramebuffers(SHADOW_CASCADES, staticFramebuffers);
+            GLStateCache::instance().forgetTexture(depthArray);
+            GLStateCache::instance().forgetTexture(staticArray);
+            glDeleteTextures(1, &depthArray);
+            glDeleteTextures(1, &staticArray);
+        }
+    }
+
+    // GL thread only. Creates the depth arrays (size x size per cascade) and their framebuffers.
+    void create(unsigned int size)
+    {
+        resolution = size;
+        createArray(depthArray, framebuffers);
+        createArray(staticArray, staticFramebuffers);
+        invalidateStatic();
+    }
+
+    // The static casters changed (e.g. the city finished loading): redraw every cache
+    void invalidateStatic() { forceRefit = true; }
+
+    // Fits the cascades to the camera (view matrix and perspective parameters, fovY in radians) for
+    // a directional light shining along lightDirection. Shadows reach up to farPlane.
+    void update(const glm::mat4 &view, float fovY, float aspect, float nearPlane, float farPlane,
+                const glm::vec3 &lightDirection)
+    {
+        glm::mat4 cameraToWorld = glm::inverse(view);
+        glm::vec3 cameraPos = glm::vec3(cameraToWorld[3]);
+        glm::vec3 forward = -glm::normalize(glm::vec3(cameraToWorld[2]));
+
+        // The light's view only follows the sun in steps of refreshAngle, and every cache is redrawn then
+        glm::vec3 direction = glm::normalize(lightDirection);
+        bool refitAll = forceRefit || glm::dot(direction, cachedDirection) < std::cos(glm::radians(refreshAngle));
+        if (refitAll)
+        {
+            cachedDirection = direction;
+            glm::vec3 up = std::fabs(direction.y) > 0.999f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+            lightView = glm::lookAt(glm::vec3(0.0f), direction, up);
+            forceRefit = false;
+        }
+
+        // Squared half-diagonal of the view slice per unit of depth
+        float tanHalfFov = std::tan(fovY * 0.5f);
+        float k = tanHalfFov * tanHalfFov * (1.0f + aspect * aspect);
+
+        staticRefreshes = 0;
+        float sliceNear = nearPlane;
+        for (int i = 0; i < SHADOW_CASCADES; i++)
+        {
+            // Practical split scheme: blend of the logarithmic and the uniform split
+            float t = (float)(i + 1) / SHADOW_CASCADES;
+            float logSplit = nearPlane * std::pow(farPlane / nearPlane, t);
+            float uniformSplit = nearPlane + (farPlane - nearPlane) * t;
+            float sliceFar = splitLambda * logSplit + (1.0f - splitLambda) * uniformSplit;
+            splits[i] = sliceFar;
+
+            // Smallest sphere around the slice, centered on the view axis: equidistant from the near and
+            // far corners, or at the far plane's center when that is already enough
+            float along = std::min(0.5f * (sliceNear + sliceFar) * (1.0f + k), sliceFar);
+            float radius = std::sqrt((sliceFar - along) * (sliceFar - along) + sliceFar * sliceFar * k);
+            glm::vec3 center = glm::vec3(lightView * glm::vec4(cameraPos + forward * along, 1.0f));
+            sliceNear = sliceFar;
+
+            // Keep the box while the sphere is inside it
+            float halfSize = (1.0f + cacheMargin) * radius;
+            glm::vec3 offset = glm::abs(center - boxCenter[i]);
+            bool inside = boxHalfSize[i] == halfSize && std::max(offset.x, std::max(offset.y, offset.z)) + radius <= halfSize;
+            if (inside && !refitAll)
+                continue;
+
+            // Refit around the sphere, snapped to whole texels of the cascade
+            float texel = 2.0f * halfSize / resolution;
+            center.x = std::floor(center.x / texel) * texel;
+            center.y = std::floor(center.y / texel) * texel;
+            boxCenter[i] = center;
+            boxHalfSize[i] = halfSize;
+
+            // The light looks down -z: the near plane sits casterDistance beyond the box towards the sun
+            float depth = -center.z;
+            glm::mat4 lightProjection = glm::ortho(center.x - halfSize, center.x + halfSize,
+                                                   center.y - halfSize, center.y + halfSize,
+                                                   depth - halfSize - casterDistance, depth + halfSize);
+            matrices[i] = lightProjection * lightView;
+            frustums[i] = Frustum::fromMatrix(matrices[i]);
+            texelSize[i] = texel;
+            depthRange[i] = 2.0f * halfSize + casterDistance;
+            staticDirty[i] = true;
+        }
+        for (int i = 0; i < SHADOW_CASCADES; i++)
+            staticRefreshes += staticDirty[i] ? 1 : 0;
+    }
+
+    ShadowUniformData uniformData() const
+    {
+        ShadowUniformData data;
+        for (int i = 0; i < SHADOW_CASCADES; i++)
+        {
+            data.cascadeMatrices[i] = matrices[i];
+            data.splits[i] = splits[i];
+            data.depthBias[i] = depthBiasTexels * texelSize[i] / depthRange[i];
+        }
+        return data;
+    }
+
+    // Render target of cascade i's static cache: binds its framebuffer, sets the viewport and clears
+    // depth. Only when staticDirty[i]; the cache is up to date once this pass has been drawn.
+    void beginStaticCascade(int i)
+    {
+        GLStateCache::instance().bindFramebuffer(staticFramebuffers[i]);
+        glViewport(0, 0, resolution, resolution);
+        glClear(GL_DEPTH_BUFFER_BIT);
+        staticDirty[i] = false;
+    }
+
+    // Render target of cascade i for the dynamic casters: starts as a copy of the static cache
+    void beginCascade(int i)
+    {
+        GLStateCache::instance().blitDepth(staticFramebuffers[i], framebuffers[i], resolution, resolution);
+        glViewport(0, 0, resolution, resolution);
+    }
+
+private:
+    glm::vec3 cachedDirection = glm::vec3(0.0f);
+    glm::mat4 lightView = glm::mat4(1.0f);
+    glm::vec3 boxCenter[SHADOW_CASCADES];   // light view space
+    float boxHalfSize[SHADOW_CASCADES] = {};
+    bool forceRefit = true;
+
+    void createArray(unsigned int &texture, unsigned int *layerFramebuffers)
+    {
+        GLStateCache &gl = GLStateCache::instance();
+        glGenTextures(1, &texture);
+        gl.bindTexture2DArray(1, texture);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, resolution, resolution, SHADOW_CASCADES, 0,
+                     GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+        float borderColor[] = { 1.0, 1.0, 1.0, 1.0 };
+        glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, borderColor);
+
+        glGenFramebuffers(SHADOW_CASCADES, layerFramebuffers);
+        for (int i = 0; i < SHADOW_CASCADES; i++)
+        {
+            gl.bindFramebuffer(layerFramebuffers[i]);
+            glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, i);
+            glDrawBuffer(GL_NONE);
+            glReadBuffer(GL_NONE);
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+                std::cout << "ERROR::SHADOWCASCADES::FRAMEBUFFER_INCOMPLETE cascade " << i << std::endl;
+        }
+        gl.bindFramebuffer(0);
+    }
+};
@@ -0,0 +1,382 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#include <immintrin.h>
+#define SIM_KERNELS_X86 1
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define SIM_TARGET_SSE41
+#define SIM_TARGET_AVX2
+#else
+#define SIM_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define SIM_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+// Batch update kernels for the entity pools (EntityPool.h), in scalar, SSE4.1 (4 lanes) and AVX2
+// (8 lanes) versions. The widest one the CPU supports is picked at runtime; the SIMD versions do the
+// same arithmetic as the scalar one except for atan2, which is a polynomial good to ~2e-6 radians.
+enum SimKernelLevel {
+    SIM_SCALAR = 0,
+    SIM_SSE41  = 1,
+    SIM_AVX2   = 2
+};
+
+inline const char *SimKernelLevelName(SimKernelLevel level)
+{
+    switch (level)
+    {
+    case SIM_AVX2:  return "AVX2";
+    case SIM_SSE41: return "SSE4.1";
+    default:        return "scalar";
+    }
+}
+
+// Enemies flying towards their targets, see EnemyPool::steer
+struct EnemySteerBatch {
+    float *posX, *posY, *posZ;
+    const float *targetX, *targetZ;
+    const float *speed;
+    float *yaw;
+    float *propellerAngle;
+    const unsigned char *blocked;   // 1 = climb instead of moving on
+    unsigned char *reachedTarget;
+    uint32_t count;
+    float deltaTime;
+    float reach;
+
+    // Entities [begin, end) as a batch of their own, so ranges can run as separate jobs
+    EnemySteerBatch slice(uint32_t begin, uint32_t end) const
+    {
+        EnemySteerBatch b = *this;
+        b.posX += begin; b.posY += begin; b.posZ += begin;
+        b.targetX += begin; b.targetZ += begin;
+        b.speed += begin;
+        b.yaw += begin;
+        b.propellerAngle += begin;
+        b.blocked += begin;
+        b.reachedTarget += begin;
+        b.count = end - begin;
+        return b;
+    }
+};
+
+// Bullets moving in a straight line and ageing, see ProjectilePool::integrate
+struct ProjectileBatch {
+    float *posX, *posY, *posZ;
+    const float *velX, *velY, *velZ;
+    float *life;
+    uint32_t count;
+    float deltaTime;
+
+    ProjectileBatch slice(uint32_t begin, uint32_t end) const
+    {
+        ProjectileBatch b = *this;
+        b.posX += begin; b.posY += begin; b.posZ += begin;
+        b.velX += begin; b.velY += begin; b.velZ += begin;
+        b.life += begin;
+        b.count = end - begin;
+        return b;
+    }
+};
+
+namespace SimKernels {
+
+const float IDLE_PROPELLER_SPEED = 600.0f;      // degrees per second
+const float PROPELLER_SPEED_PER_UNIT = 90.0f;   // extra degrees per second per unit of speed
+const float MIN_TARGET_DISTANCE = 0.001f;       // closer than this there's no direction to face
+
+// --- Scalar: the reference, and the tail of every SIMD loop ---
+
+inline void steerEnemiesScalar(const EnemySteerBatch &b, uint32_t begin)
+{
+    for (uint32_t i = begin; i < b.count; i++)
+    {
+        float dx = b.targetX[i] - b.posX[i];
+        float dz = b.targetZ[i] - b.posZ[i];
+        float dist = std::sqrt(dx * dx + dz * dz);
+        float inverse = dist > MIN_TARGET_DISTANCE ? 1.0f / dist : 0.0f;
+        dx *= inverse;
+        dz *= inverse;
+
+        float step = b.speed[i] * b.deltaTime;
+        if (b.blocked[i])
+        {
+            b.posY[i] += step;
+        }
+        else
+        {
+            b.posX[i] += dx * step;
+            b.posZ[i] += dz * step;
+        }
+        b.reachedTarget[i] = dist < b.reach ? 1 : 0;
+        if (dist > MIN_TARGET_DISTANCE)
+            b.yaw[i] = std::atan2(dx, dz);
+
+        float angle = b.propellerAngle[i] + (IDLE_PROPELLER_SPEED + b.speed[i] * PROPELLER_SPEED_PER_UNIT) * b.deltaTime;
+        b.propellerAngle[i] = angle >= 360.0f ? angle - 360.0f : angle;
+    }
+}
+
+inline void integrateProjectilesScalar(const ProjectileBatch &b, uint32_t begin)
+{
+    for (uint32_t i = begin; i < b.count; i++)
+    {
+        b.posX[i] += b.velX[i] * b.deltaTime;
+        b.posY[i] += b.velY[i] * b.deltaTime;
+        b.posZ[i] += b.velZ[i] * b.deltaTime;
+        b.life[i] -= b.deltaTime;
+    }
+}
+
+#ifdef SIM_KERNELS_X86
+
+// atan(a) for a in [0, 1], minimax polynomial
+#define SIM_ATAN_C0  0.99997726f
+#define SIM_ATAN_C1 -0.33262347f
+#define SIM_ATAN_C2  0.19354346f
+#define SIM_ATAN_C3 -0.11643287f
+#define SIM_ATAN_C4  0.05265332f
+#define SIM_ATAN_C5 -0.01172120f
+
+// --- SSE4.1, 4 lanes ---
+
+SIM_TARGET_SSE41 inline __m128 atan2SSE(__m128 y, __m128 x)
+{
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    __m128 ax = _mm_andnot_ps(signMask, x), ay = _mm_andnot_ps(signMask, y);
+    __m128 big = _mm_max_ps(ax, ay), small = _mm_min_ps(ax, ay);
+    __m128 a = _mm_div_ps(small, _mm_max_ps(big, _mm_set1_ps(1e-30f)));
+    __m128 s = _mm_mul_ps(a, a);
+    __m128 r = _mm_set1_ps(SIM_ATAN_C5);
+    r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(SIM_ATAN_C4));
+    r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(SIM_ATAN_C3));
+    r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(SIM_ATAN_C2));
+    r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(SIM_ATAN_C1));
+    r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(SIM_ATAN_C0));
+    r = _mm_mul_ps(r, a);
+    r = _mm_blendv_ps(r, _mm_sub_ps(_mm_set1_ps(1.57079637f), r), _mm_cmpgt_ps(ay, ax));
+    r = _mm_blendv_ps(r, _mm_sub_ps(_mm_set1_ps(3.14159274f), r), _mm_cmplt_ps(x, _mm_setzero_ps()));
+    return _mm_or_ps(r, _mm_and_ps(y, signMask));
+}
+
+SIM_TARGET_SSE41 inline void steerEnemiesSSE(const EnemySteerBatch &b)
+{
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 minDistance = _mm_set1_ps(MIN_TARGET_DISTANCE);
+    const __m128 reach = _mm_set1_ps(b.reach);
+    const __m128 deltaTime = _mm_set1_ps(b.deltaTime);
+    const __m128 idle = _mm_set1_ps(IDLE_PROPELLER_SPEED);
+    const __m128 perUnit = _mm_set1_ps(PROPELLER_SPEED_PER_UNIT);
+    const __m128 fullTurn = _mm_set1_ps(360.0f);
+
+    uint32_t i = 0;
+    for (; i + 4 <= b.count; i += 4)
+    {
+        __m128 px = _mm_loadu_ps(b.posX + i), py = _mm_loadu_ps(b.posY + i), pz = _mm_loadu_ps(b.posZ + i);
+        __m128 dx = _mm_sub_ps(_mm_loadu_ps(b.targetX + i), px);
+        __m128 dz = _mm_sub_ps(_mm_loadu_ps(b.targetZ + i), pz);
+        __m128 dist = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dz, dz)));
+        __m128 facing = _mm_cmpgt_ps(dist, minDistance);
+        __m128 inverse = _mm_and_ps(facing, _mm_div_ps(one, _mm_max_ps(dist, minDistance)));
+        dx = _mm_mul_ps(dx, inverse);
+        dz = _mm_mul_ps(dz, inverse);
+
+        __m128 speed = _mm_loadu_ps(b.speed + i);
+        __m128 step = _mm_mul_ps(speed, deltaTime);
+        int32_t blockedBytes;
+        std::memcpy(&blockedBytes, b.blocked + i, 4);
+        __m128 blocked = _mm_castsi128_ps(_mm_cmpgt_epi32(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(blockedBytes)), _mm_setzero_si128()));
+        _mm_storeu_ps(b.posX + i, _mm_add_ps(px, _mm_andnot_ps(blocked, _mm_mul_ps(dx, step))));
+        _mm_storeu_ps(b.posY + i, _mm_add_ps(py, _mm_and_ps(blocked, step)));
+        _mm_storeu_ps(b.posZ + i, _mm_add_ps(pz, _mm_andnot_ps(blocked, _mm_mul_ps(dz, step))));
+
+        int reached = _mm_movemask_ps(_mm_cmplt_ps(dist, reach));
+        for (int lane = 0; lane < 4; lane++)
+            b.reachedTarget[i + lane] = (reached >> lane) & 1;
+
+        __m128 yaw = _mm_blendv_ps(_mm_loadu_ps(b.yaw + i), atan2SSE(dx, dz), facing);
+        _mm_storeu_ps(b.yaw + i, yaw);
+
+        __m128 angle = _mm_add_ps(_mm_loadu_ps(b.propellerAngle + i),
+                                  _mm_mul_ps(_mm_add_ps(idle, _mm_mul_ps(speed, perUnit)), deltaTime));
+        angle = _mm_sub_ps(angle, _mm_and_ps(_mm_cmpge_ps(angle, fullTurn), fullTurn));
+        _mm_storeu_ps(b.propellerAngle + i, angle);
+    }
+    steerEnemiesScalar(b, i);
+}
+
+SIM_TARGET_SSE41 inline void integrateProjectilesSSE(const ProjectileBatch &b)
+{
+    const __m128 deltaTime = _mm_set1_ps(b.deltaTime);
+    uint32_t i = 0;
+    for (; i + 4 <= b.count; i += 4)
+    {
+        _mm_storeu_ps(b.posX + i, _mm_add_ps(_mm_loadu_ps(b.posX + i), _mm_mul_ps(_mm_loadu_ps(b.velX + i), deltaTime)));
+        _mm_storeu_ps(b.posY + i, _mm_add_ps(_mm_loadu_ps(b.posY + i), _mm_mul_ps(_mm_loadu_ps(b.velY + i), deltaTime)));
+        _mm_storeu_ps(b.posZ + i, _mm_add_ps(_mm_loadu_ps(b.posZ + i), _mm_mul_ps(_mm_loadu_ps(b.velZ + i), deltaTime)));
+        _mm_storeu_ps(b.life + i, _mm_sub_ps(_mm_loadu_ps(b.life + i), deltaTime));
+    }
+    integrateProjectilesScalar(b, i);
+}
+
+// --- AVX2, 8 lanes ---
+
+SIM_TARGET_AVX2 inline __m256 atan2AVX(__m256 y, __m256 x)
+{
+    const __m256 signMask = _mm256_set1_ps(-0.0f);
+    __m256 ax = _mm256_andnot_ps(signMask, x), ay = _mm256_andnot_ps(signMask, y);
+    __m256 big = _mm256_max_ps(ax, ay), small = _mm256_min_ps(ax, ay);
+    __m256 a = _mm256_div_ps(small, _mm256_max_ps(big, _mm256_set1_ps(1e-30f)));
+    __m256 s = _mm256_mul_ps(a, a);
+    __m256 r = _mm256_set1_ps(SIM_ATAN_C5);
+    r = _mm256_add_ps(_mm256_mul_ps(r, s), _mm256_set1_ps(SIM_ATAN_C4));
+    r = _mm256_add_ps(_mm256_mul_ps(r, s), _mm256_set1_ps(SIM_ATAN_C3));
+    r = _mm256_add_ps(_mm256_mul_ps(r, s), _mm256_set1_ps(SIM_ATAN_C2));
+    r = _mm256_add_ps(_mm256_mul_ps(r, s), _mm256_set1_ps(SIM_ATAN_C1));
+    r = _mm256_add_ps(_mm256_mul_ps(r, s), _mm256_set1_ps(SIM_ATAN_C0));
+    r = _mm256_mul_ps(r, a);
+    r = _mm256_blendv_ps(r, _mm256_sub_ps(_mm256_set1_ps(1.57079637f), r), _mm256_cmp_ps(ay, ax, _CMP_GT_OQ));
+    r = _mm256_blendv_ps(r, _mm256_sub_ps(_mm256_set1_ps(3.14159274f), r), _mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_LT_OQ));
+    return _mm256_or_ps(r, _mm256_and_ps(y, signMask));
+}
+
+SIM_TARGET_AVX2 inline void steerEnemiesAVX2(const EnemySteerBatch &b)
+{
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 minDistance = _mm256_set1_ps(MIN_TARGET_DISTANCE);
+    const __m256 reach = _mm256_set1_ps(b.reach);
+    const __m256 deltaTime = _mm256_set1_ps(b.deltaTime);
+    const __m256 idle = _mm256_set1_ps(IDLE_PROPELLER_SPEED);
+    const __m256 perUnit = _mm256_set1_ps(PROPELLER_SPEED_PER_UNIT);
+    const __m256 fullTurn = _mm256_set1_ps(360.0f);
+
+    uint32_t i = 0;
+    for (; i + 8 <= b.count; i += 8)
+    {
+        __m256 px = _mm256_loadu_ps(b.posX + i), py = _mm256_loadu_ps(b.posY + i), pz = _mm256_loadu_ps(b.posZ + i);
+        __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(b.targetX + i), px);
+        __m256 dz = _mm256_sub_ps(_mm256_loadu_ps(b.targetZ + i), pz);
+        __m256 dist = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dz, dz)));
+        __m256 facing = _mm256_cmp_ps(dist, minDistance, _CMP_GT_OQ);
+        __m256 inverse = _mm256_and_ps(facing, _mm256_div_ps(one, _mm256_max_ps(dist, minDistance)));
+        dx = _mm256_mul_ps(dx, inverse);
+        dz = _mm256_mul_ps(dz, inverse);
+
+        __m256 speed = _mm256_loadu_ps(b.speed + i);
+        __m256 step = _mm256_mul_ps(speed, deltaTime);
+        __m256i blockedBytes = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(b.blocked + i)));
+        __m256 blocked = _mm256_castsi256_ps(_mm256_cmpgt_epi32(blockedBytes, _mm256_setzero_si256()));
+        _mm256_storeu_ps(b.posX + i, _mm256_add_ps(px, _mm256_andnot_ps(blocked, _mm256_mul_ps(dx, step))));
+        _mm256_storeu_ps(b.posY + i, _mm256_add_ps(py, _mm256_and_ps(blocked, step)));
+        _mm256_storeu_ps(b.posZ + i, _mm256_add_ps(pz, _mm256_andnot_ps(blocked, _mm256_mul_ps(dz, step))));
+
+        int reached = _mm256_movemask_ps(_mm256_cmp_ps(dist, reach, _CMP_LT_OQ));
+        for (int lane = 0; lane < 8; lane++)
+            b.reachedTarget[i + lane] = (reached >> lane) & 1;
+
+        __m256 yaw = _mm256_blendv_ps(_mm256_loadu_ps(b.yaw + i), atan2AVX(dx, dz), facing);
+        _mm256_storeu_ps(b.yaw + i, yaw);
+
+        __m256 angle = _mm256_add_ps(_mm256_loadu_ps(b.propellerAngle + i),
+                                     _mm256_mul_ps(_mm256_add_ps(idle, _mm256_mul_ps(speed, perUnit)), deltaTime));
+        angle = _mm256_sub_ps(angle, _mm256_and_ps(_mm256_cmp_ps(angle, fullTurn, _CMP_GE_OQ), fullTurn));
+        _mm256_storeu_ps(b.propellerAngle + i, angle);
+    }
+    steerEnemiesScalar(b, i);
+}
+
+SIM_TARGET_AVX2 inline void integrateProjectilesAVX2(const ProjectileBatch &b)
+{
+    const __m256 deltaTime = _mm256_set1_ps(b.deltaTime);
+    uint32_t i = 0;
+    for (; i + 8 <= b.count; i += 8)
+    {
+        _mm256_storeu_ps(b.posX + i, _mm256_add_ps(_mm256_loadu_ps(b.posX + i), _mm256_mul_ps(_mm256_loadu_ps(b.velX + i), deltaTime)));
+        _mm256_storeu_ps(b.posY + i, _mm256_add_ps(_mm256_loadu_ps(b.posY + i), _mm256_mul_ps(_mm256_loadu_ps(b.velY + i), deltaTime)));
+        _mm256_storeu_ps(b.posZ + i, _mm256_add_ps(_mm256_loadu_ps(b.posZ + i), _mm256_mul_ps(_mm256_loadu_ps(b.velZ + i), deltaTime)));
+        _mm256_storeu_ps(b.life + i, _mm256_sub_ps(_mm256_loadu_ps(b.life + i), deltaTime));
+    }
+    integrateProjectilesScalar(b, i);
+}
+
+#endif // SIM_KERNELS_X86
+
+// Widest level this CPU (and OS, for the AVX registers) supports
+inline SimKernelLevel detectLevel()
+{
+#ifdef SIM_KERNELS_X86
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+    __cpuid(info, 1);
+    bool sse41 = (info[2] & (1 << 19)) != 0;
+    bool osAVX = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && ((_xgetbv(0) & 6) == 6);
+    bool avx2 = false;
+    if (osAVX && maxLeaf >= 7)
+    {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+    }
+    if (avx2)
+        return SIM_AVX2;
+    if (sse41)
+        return SIM_SSE41;
+#else
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return SIM_AVX2;
+    if (__builtin_cpu_supports("sse4.1"))
+        return SIM_SSE41;
+#endif
+#endif
+    return SIM_SCALAR;
+}
+
+// The level the dispatchers below use: detected on first use, can be lowered (e.g. for benchmarks)
+inline SimKernelLevel &activeLevel()
+{
+    static SimKernelLevel level = detectLevel();
+    return level;
+}
+
+// Sets the level, clamped to what the CPU supports. Returns the level actually used.
+inline SimKernelLevel setLevel(SimKernelLevel level)
+{
+    SimKernelLevel supported = detectLevel();
+    activeLevel() = level < supported ? level : supported;
+    return activeLevel();
+}
+
+inline void steerEnemies(const EnemySteerBatch &batch)
+{
+#ifdef SIM_KERNELS_X86
+    switch (activeLevel())
+    {
+    case SIM_AVX2:  steerEnemiesAVX2(batch); return;
+    case SIM_SSE41: steerEnemiesSSE(batch); return;
+    default: break;
+    }
+#endif
+    steerEnemiesScalar(batch, 0);
+}
+
+inline void integrateProjectiles(const ProjectileBatch &batch)
+{
+#ifdef SIM_KERNELS_X86
+    switch (activeLevel())
+    {
+    case SIM_AVX2:  integrateProjectilesAVX2(batch); return;
+    case SIM_SSE41: integrateProjectilesSSE(batch); return;
+    default: break;
+    }
+#endif
+    integrateProjectilesScalar(batch, 0);
+}
+
+} // namespace SimKernels
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "EntityPool.h"
+
+#include <cmath>
+#include <memory>
+#include <vector>
+
+class Model;
+
+// Player controls and what the simulation needs from the render side, sampled once per rendered
+// frame; the simulation applies the latest one to every step until the next arrives
+struct SimInput {
+    bool speedUp = false, slowDown = false;
+    bool yawLeft = false, yawRight = false;
+    bool pitchUp = false, pitchDown = false;
+    unsigned int fireCount = 0;         // trigger presses so far; each new one fires a volley
+    bool fire = false;                  // set by the simulation on the step that fires
+    glm::vec3 cameraDirection = glm::vec3(0.0f, 0.0f, 1.0f);   // Camera::OrbitDirection()
+    float cameraDistance = 15.0f;       // Camera::Distance
+    float enemyRadius = 0.0f;           // enemy model's bounding radius in world units
+    std::shared_ptr<Model> city;        // once the city is on the GPU, for the collision BVH
+};
+
+// The player's plane as of one simulation step
+struct PlaneState {
+    glm::vec3 pos = glm::vec3(0.0f);
+    glm::quat orientation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+    float propellerAngle = 0.0f;        // degrees, wraps at 360
+    float rudderAngle = 0.0f;
+    float flapAngle = 0.0f;
+};
+
+struct EnemyRenderState {
+    EntityHandle handle;                // stays the same for as long as the enemy lives
+    glm::vec3 previousPos, pos;
+    float previousYaw, yaw;             // radians
+    float previousPropellerAngle, propellerAngle;  // degrees, wraps at 360
+};
+
+struct ProjectileRenderState {
+    glm::vec3 previousPos, pos;
+    glm::vec3 direction;                // normalized
+};
+
+struct ExplosionRenderState {
+    glm::vec3 pos;
+    float previousProgress, progress;   // 0 at the start, 1 at the end
+};
+
+// Everything the renderer reads from the simulation. Each entry holds the state at the last two
+// steps, so a frame falling between them is drawn by interpolating (see Lerp* below).
+struct RenderState {
+    double time = 0.0;                  // glfwGetTime() the current step corresponds to
+    PlaneState previousPlane, plane;
+    float planeSpeed = 0.0f;
+    float cameraCollisionDistance = 0.0f;
+    std::vector<EnemyRenderState> enemies;
+    std::vector<ProjectileRenderState> projectiles;
+    std::vector<ExplosionRenderState> explosions;
+
+    // Counters of the last step, for the window title
+    unsigned int raysCast = 0;
+    unsigned int dynamicCandidates = 0;
+    float stepMicroseconds = 0.0f;      // simulation thread time per step
+};
+
+// Angle interpolation the short way round, for angles that wrap at `turn`
+inline float LerpAngle(float from, float to, float t, float turn)
+{
+    float delta = std::fmod(to - from, turn);
+    if (delta > turn * 0.5f)
+        delta -= turn;
+    else if (delta < -turn * 0.5f)
+        delta += turn;
+    return from + delta * t;
+}
+
+inline PlaneState LerpPlane(const PlaneState &from, const PlaneState &to, float t)
+{
+    PlaneState plane;
+    plane.pos = glm::mix(from.pos, to.pos, t);
+    plane.orientation = glm::slerp(from.orientation, to.orientation, t);
+    plane.propellerAngle = LerpAngle(from.propellerAngle, to.propellerAngle, t, 360.0f);
+    plane.rudderAngle = glm::mix(from.rudderAngle, to.rudderAngle, t);
+    plane.flapAngle = glm::mix(from.flapAngle, to.flapAngle, t);
+    return plane;
+}
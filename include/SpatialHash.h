@@ -0,0 +1,96 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Uniform grid over spheres, stored as a hash table of cells so the world needs no fixed extent.
+// Rebuilt from scratch every frame with a counting sort: bucketStart[b]..bucketStart[b + 1] indexes
+// `entries`, which holds sphere indices. Each sphere goes into the cell of its center; queries grow
+// their box by the largest radius, so spheres overlapping a neighbouring cell are still found.
+// Distinct cells can share a bucket, so visitors may see extra candidates (never miss one).
+class SpatialHash
+{
+public:
+    // spheres: xyz = center, w = radius
+    void build(const std::vector<glm::vec4> &spheres, float cellSize)
+    {
+        this->cellSize = cellSize > 0.0f ? cellSize : 1.0f;
+        inverseCellSize = 1.0f / this->cellSize;
+        count = (uint32_t)spheres.size();
+
+        uint32_t buckets = 16;
+        while (buckets < count * 2)
+            buckets <<= 1;
+        mask = buckets - 1;
+
+        maxRadius = 0.0f;
+        bucketOf.resize(count);
+        bucketStart.assign(buckets + 1, 0);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            const glm::vec4 &sphere = spheres[i];
+            maxRadius = std::max(maxRadius, sphere.w);
+            bucketOf[i] = bucket(cellCoord(sphere.x), cellCoord(sphere.y), cellCoord(sphere.z));
+            bucketStart[bucketOf[i] + 1]++;
+        }
+        for (uint32_t b = 0; b < buckets; b++)
+            bucketStart[b + 1] += bucketStart[b];
+
+        entries.resize(count);
+        fill.assign(bucketStart.begin(), bucketStart.end() - 1);
+        for (uint32_t i = 0; i < count; i++)
+            entries[fill[bucketOf[i]]++] = i;
+    }
+
+    // Calls visit(index) for every sphere that may overlap the box [minCorner, maxCorner].
+    template <typename Visitor>
+    void query(const glm::vec3 &minCorner, const glm::vec3 &maxCorner, Visitor &&visit) const
+    {
+        if (count == 0)
+            return;
+        int x0 = cellCoord(minCorner.x - maxRadius), x1 = cellCoord(maxCorner.x + maxRadius);
+        int y0 = cellCoord(minCorner.y - maxRadius), y1 = cellCoord(maxCorner.y + maxRadius);
+        int z0 = cellCoord(minCorner.z - maxRadius), z1 = cellCoord(maxCorner.z + maxRadius);
+
+        // A box spanning more cells than there are buckets would only revisit them: scan everything
+        double cells = (double)(x1 - x0 + 1) * (y1 - y0 + 1) * (z1 - z0 + 1);
+        if (cells > (double)(mask + 1))
+        {
+            for (uint32_t i = 0; i < count; i++)
+                visit(i);
+            return;
+        }
+
+        for (int z = z0; z <= z1; z++)
+            for (int y = y0; y <= y1; y++)
+                for (int x = x0; x <= x1; x++)
+                {
+                    uint32_t b = bucket(x, y, z);
+                    for (uint32_t e = bucketStart[b]; e < bucketStart[b + 1]; e++)
+                        visit(entries[e]);
+                }
+    }
+
+    uint32_t size() const { return count; }
+
+private:
+    float    cellSize = 1.0f;
+    float    inverseCellSize = 1.0f;
+    float    maxRadius = 0.0f;
+    uint32_t count = 0;
+    uint32_t mask = 0;
+    std::vector<uint32_t> bucketStart;
+    std::vector<uint32_t> entries;
+    std::vector<uint32_t> bucketOf, fill;    // build scratch
+
+    int cellCoord(float v) const { return (int)std::floor(v * inverseCellSize); }
+
+    uint32_t bucket(int x, int y, int z) const
+    {
+        return (((uint32_t)x * 73856093u) ^ ((uint32_t)y * 19349663u) ^ ((uint32_t)z * 83492791u)) & mask;
+    }
+};
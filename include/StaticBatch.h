@@ -0,0 +1,129 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "GLStateCache.h"
+#include "Model.h"
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+// The meshes of one material that a pass draws this frame, submitted with a single
+// glMultiDrawElementsBaseVertex
+struct BatchRanges {
+    std::vector<GLsizei>        counts;
+    std::vector<const void*>    offsets;        // byte offsets into the arena page's index buffer
+    std::vector<GLint>          baseVertices;
+    std::vector<unsigned char>  lods;           // for the triangle counters
+
+    bool empty() const { return counts.empty(); }
+    void clear() { counts.clear(); offsets.clear(); baseVertices.clear(); lods.clear(); }
+};
+
+// Static batching for a model that never moves (the city). Every mesh is already a slice of a
+// MeshArena() page, so meshes sharing a material (diffuse texture) and a page can be drawn together
+// straight from the arena, each at its own base vertex and LOD. A frame adds the meshes that survived
+// culling per pass, and each material is then drawn with one multi-draw call and one VAO bind,
+// however many meshes it has.
+class StaticBatch
+{
+public:
+    struct Material {
+        unsigned int texture = 0;   // texture_diffuse1, 0 for none
+        unsigned int VAO = 0;       // the arena page's
+        size_t meshes = 0;
+        int firstMesh = 0;          // its packed-position dequantization is the material's
+    };
+
+    std::vector<Material> materials;
+    std::vector<int> materialOf;    // per mesh of the model
+
+    bool empty() const { return materials.empty(); }
+
+    // Groups the model's meshes by material. Nothing is copied; the model must outlive the batch.
+    void build(const Model &model)
+    {
+        release();
+        batched = &model;
+        materialOf.assign(model.meshes.size(), -1);
+        for (size_t m = 0; m < model.meshes.size(); m++)
+        {
+            const Mesh &mesh = model.meshes[m];
+            unsigned int texture = mesh.diffuseTexture();
+            int material = 0;
+            while (material < (int)materials.size() && !sameMaterial(materials[material], mesh))
+                material++;
+            if (material == (int)materials.size())
+            {
+                materials.emplace_back();
+                materials.back().texture = texture;
+                materials.back().VAO = mesh.VAO;
+                materials.back().firstMesh = (int)m;
+            }
+            materials[material].meshes++;
+            materialOf[m] = material;
+        }
+        std::cout << "StaticBatch: " << model.meshes.size() << " meshes in " << materials.size() << " materials" << std::endl;
+    }
+
+    // Starts a frame: drops the ranges of the last one. passCount is the number of passes add() may use.
+    void begin(int passCount)
+    {
+        ranges.resize((size_t)passCount * materials.size());
+        for (BatchRanges &r : ranges)
+            r.clear();
+    }
+
+    // Mesh `mesh` of the model, at level of detail lod, is drawn in pass
+    void add(int pass, size_t mesh, int lod)
+    {
+        const Mesh &source = batched->meshes[mesh];
+        const GeometrySlice &slice = source.slice();
+        const MeshLod &range = source.lods[std::min(lod, source.lodCount - 1)];
+        BatchRanges &r = ranges[(size_t)pass * materials.size() + materialOf[mesh]];
+        r.counts.push_back((GLsizei)range.indexCount);
+        r.offsets.push_back((const void*)((slice.firstIndex + range.firstIndex) * sizeof(unsigned int)));
+        r.baseVertices.push_back((GLint)slice.baseVertex);
+        r.lods.push_back((unsigned char)std::min(lod, source.lodCount - 1));
+    }
+
+    const BatchRanges &rangesOf(int pass, int material) const { return ranges[(size_t)pass * materials.size() + material]; }
+
+    // Draws what add() collected for pass and material (shader is in use, with the model uniform set)
+    void draw(const Shader &shader, int pass, int material)
+    {
+        const BatchRanges &r = rangesOf(pass, material);
+        if (r.empty())
+            return;
+        batched->meshes[materials[material].firstMesh].setPositionDequantization(shader);
+        GLStateCache &gl = GLStateCache::instance();
+        if (materials[material].texture)
+            gl.bindTexture2D(0, materials[material].texture);
+        gl.bindVertexArray(materials[material].VAO);
+        glMultiDrawElementsBaseVertex(GL_TRIANGLES, r.counts.data(), GL_UNSIGNED_INT, r.offsets.data(),
+                                      (GLsizei)r.counts.size(), r.baseVertices.data());
+        gl.countMultiDraw((unsigned int)r.counts.size());
+        for (size_t i = 0; i < r.counts.size(); i++)
+            gl.countTriangles(r.lods[i], (unsigned int)r.counts[i] / 3);
+    }
+
+    void release()
+    {
+        materials.clear();
+        materialOf.clear();
+        ranges.clear();
+        batched = nullptr;
+    }
+
+private:
+    const Model *batched = nullptr;
+
+    bool sameMaterial(const Material &material, const Mesh &mesh) const
+    {
+        const Mesh &first = batched->meshes[material.firstMesh];
+        return material.texture == mesh.diffuseTexture() && material.VAO == mesh.VAO
+            && first.positionOffset == mesh.positionOffset && first.positionScale == mesh.positionScale;
+    }
+    std::vector<BatchRanges> ranges;    // [pass * materials.size() + material]
+};
@@ -0,0 +1,235 @@
+#pragma once
+
+#include <glad/glad.h>
+#include "stb_image.h"
+#include "GLStateCache.h"
+#include "Hash.h"
+
+#include <cstdint>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Pixels decoded by stb_image in a load job, waiting for the GL upload
+struct DecodedImage {
+    std::string path;
+    unsigned char *pixels = nullptr;
+    int width = 0, height = 0, components = 0;
+};
+
+// Forward declaration
+unsigned int UploadTexture(DecodedImage &image);
+
+// Identifies an image by its encoded (PNG/JPEG/...) bytes: their hash and their size, so a hash
+// collision between images of different sizes can't hand one mesh another's texture
+typedef std::pair<uint64_t, uint64_t> TextureKey;
+
+// One distinct image
+struct TextureRecord {
+    TextureKey              key;
+    DecodedImage            image;          // pixels are freed once uploaded
+    std::shared_future<void> decoded;       // ready once image is filled in
+    unsigned int            id = 0;         // GL texture, 0 until the first acquire()
+    size_t                  bytes = 0;      // GPU memory, including the mip chain
+    int                     refs = 0;
+    int                     pending = 0;    // handed out by decode(), not acquired (or unpinned) yet
+
+    ~TextureRecord()
+    {
+        if (image.pixels) stbi_image_free(image.pixels);
+    }
+};
+
+// Process-wide texture cache. Every image is decoded and uploaded exactly once no matter how
+// many models (or embedded "*N" slots) reference the same bytes.
+//   decode()  - any thread: hash the encoded bytes, decode only if the content is new. The record
+//               is pinned until the load hands it to acquire() (or unpin() if it doesn't use it),
+//               so a release() in between can't free it under a load in flight.
+//   acquire() - GL thread: upload on first use, then just bump the refcount.
+//   release() - GL thread: drop a reference, deleting the GL texture once no reference or pin is left.
+class TextureCache
+{
+public:
+    static TextureCache &instance()
+    {
+        static TextureCache cache;
+        return cache;
+    }
+
+    std::shared_ptr<TextureRecord> decode(const unsigned char *bytes, size_t size, const std::string &label)
+    {
+        TextureKey key(HashBytes(bytes, size), (uint64_t)size);
+        std::shared_ptr<TextureRecord> record;
+        std::promise<void> decodedPromise;
+        bool ownsDecode = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = records.find(key);
+            if (it != records.end())
+            {
+                record = it->second;
+                decodeHits++;
+            }
+            else
+            {
+                record = std::make_shared<TextureRecord>();
+                record->key = key;
+                record->image.path = label;
+                record->decoded = decodedPromise.get_future().share();
+                records[key] = record;
+                ownsDecode = true;
+            }
+            record->pending++;
+        }
+
+        if (!ownsDecode)
+        {
+            // Another load owns the decode; wait for it so the GL phase always has pixels or an id.
+            record->decoded.wait();
+            return record;
+        }
+
+        DecodedImage &image = record->image;
+        image.pixels = stbi_load_from_memory(bytes, (int)size, &image.width, &image.height, &image.components, 0);
+        if (image.pixels)
+            record->bytes = (size_t)image.width * image.height * image.components * 4 / 3; // + mips
+        else
+            std::cout << "Texture failed to load for path: " << label << std::endl;
+        decodedPromise.set_value();
+        return record;
+    }
+
+    // Reads and decodes an image file through the cache. Returns nullptr if it can't be read.
+    std::shared_ptr<TextureRecord> decodeFile(const std::string &filename, const std::string &label)
+    {
+        std::ifstream file(filename, std::ios::binary | std::ios::ate);
+        if (!file)
+        {
+            std::cout << "Texture failed to load for path: " << label << std::endl;
+            return nullptr;
+        }
+        std::vector<unsigned char> bytes((size_t)file.tellg());
+        file.seekg(0);
+        file.read(reinterpret_cast<char*>(bytes.data()), (std::streamsize)bytes.size());
+        return decode(bytes.data(), bytes.size(), label);
+    }
+
+    // Turns decode()'s pin into a reference. id and refs only change on the GL thread, so the
+    // upload doesn't hold the lock that decoding workers take.
+    unsigned int acquire(TextureRecord &record)
+    {
+        if (record.id == 0)
+        {
+            record.id = UploadTexture(record.image);
+            uploads++;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        record.pending--;
+        record.refs++;
+        return record.id;
+    }
+
+    // GL thread only. Drops decode()'s pin on a record the load ended up not using.
+    void unpin(TextureRecord &record)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        record.pending--;
+        freeIfUnused(record.key);
+    }
+
+    // GL thread only. Another reference to a texture that is already uploaded (a model sharing it).
+    void addReference(const TextureKey &key)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = records.find(key);
+        if (it != records.end())
+            it->second->refs++;
+    }
+
+    void release(const TextureKey &key)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = records.find(key);
+        if (it == records.end())
+            return;
+        it->second->refs--;
+        freeIfUnused(key);
+    }
+
+    void printStats()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t total = 0;
+        for (const auto &entry : records)
+            total += entry.second->bytes;
+        std::cout << "TextureCache: " << records.size() << " textures, " << total / (1024 * 1024) << " MB, "
+                  << uploads << " uploads, " << decodeHits << " duplicate decodes avoided" << std::endl;
+        for (const auto &entry : records)
+        {
+            const TextureRecord &r = *entry.second;
+            std::cout << "  " << r.image.path << ": " << r.image.width << "x" << r.image.height << "x" << r.image.components
+                      << ", " << r.bytes / 1024 << " KB, " << r.refs << " refs" << std::endl;
+        }
+    }
+
+private:
+    std::mutex mutex;
+    std::map<TextureKey, std::shared_ptr<TextureRecord>> records;
+    int decodeHits = 0;
+    int uploads = 0;
+
+    TextureCache() {}
+
+    // Caller holds mutex
+    void freeIfUnused(const TextureKey &key)
+    {
+        auto it = records.find(key);
+        if (it == records.end() || it->second->refs > 0 || it->second->pending > 0)
+            return;
+        if (it->second->id)
+        {
+            GLStateCache::instance().forgetTexture(it->second->id);
+            glDeleteTextures(1, &it->second->id);
+            it->second->id = 0;
+        }
+        records.erase(it);
+    }
+};
+
+// --- GL half of the texture load. Frees the decoded pixels once they're on the GPU. ---
+inline unsigned int UploadTexture(DecodedImage &image)
+{
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+
+    if (image.pixels)
+    {
+        GLenum format = GL_RGB;
+        if (image.components == 1)
+            format = GL_RED;
+        else if (image.components == 3)
+            format = GL_RGB;
+        else if (image.components == 4)
+            format = GL_RGBA;
+
+        GLStateCache::instance().bindTexture2D(0, textureID);
+        glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.pixels);
+        glGenerateMipmap(GL_TEXTURE_2D);
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        stbi_image_free(image.pixels);
+        image.pixels = nullptr;
+    }
+
+    return textureID;
+}
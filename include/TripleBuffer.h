@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+
+// Lock-free hand-off of the latest value from one writer thread to one reader thread.
+// Of the three slots the writer owns one, the reader owns one and the third sits in between.
+// publish() swaps the writer's slot with the middle one, acquire() swaps the reader's with it
+// if something new was published. Neither side ever waits, and the reader always sees a whole
+// value: the newest published one, with older unread ones skipped.
+template <typename T>
+class TripleBuffer
+{
+public:
+    // --- Writer thread ---
+
+    // Slot to fill in; it may hold an older value, so containers keep their capacity between uses
+    T &write() { return slots[writeIndex]; }
+
+    void publish()
+    {
+        unsigned int previous = middle.exchange(writeIndex | FRESH, std::memory_order_acq_rel);
+        writeIndex = previous & INDEX_MASK;
+    }
+
+    // --- Reader thread ---
+
+    // Takes the newest published value, if there is one since the last call. Returns whether read() changed.
+    bool acquire()
+    {
+        if (!(middle.load(std::memory_order_relaxed) & FRESH))
+            return false;
+        unsigned int previous = middle.exchange(readIndex, std::memory_order_acq_rel);
+        readIndex = previous & INDEX_MASK;
+        return true;
+    }
+
+    const T &read() const { return slots[readIndex]; }
+
+private:
+    static const unsigned int INDEX_MASK = 3;
+    static const unsigned int FRESH = 4;    // set in `middle` when it holds a value the reader hasn't taken
+
+    T slots[3];
+    alignas(64) std::atomic<unsigned int> middle{1};
+    alignas(64) unsigned int writeIndex = 0;    // writer thread only
+    alignas(64) unsigned int readIndex = 2;     // reader thread only
+};
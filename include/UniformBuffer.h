@@ -0,0 +1,64 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// Uniform block binding points. Shader binds blocks with these names to these points after linking.
+const unsigned int FRAME_UNIFORM_BINDING = 0;   // "FrameData" - camera and lighting, written once per frame
+const unsigned int PASS_UNIFORM_BINDING  = 1;   // "PassData"  - light-space transform of the shadow pass being drawn
+const unsigned int SHADOW_UNIFORM_BINDING = 2;  // "ShadowData" - every cascade, for the shadow lookup in the main pass
+
+// Shadow map cascades (the [4] arrays of the ShadowData block)
+const int SHADOW_CASCADES = 4;
+
+// std140 mirror of the FrameData block in vertex.glsl / fragment.glsl / solid.vs / instanced.vs.
+// A vec3 takes 16 bytes in std140, so each one is followed by an explicit pad float.
+struct FrameUniformData {
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::vec3 viewPos;      float pad0;
+    glm::vec3 lightPos;     float pad1;
+    glm::vec3 lightColor;   float pad2;
+    glm::vec3 skyColor;     float pad3;
+    glm::vec3 groundColor;  float pad4;
+};
+static_assert(sizeof(FrameUniformData) == 208, "FrameUniformData must match the std140 FrameData block");
+
+// std140 mirror of the PassData block in vertex.glsl / shadow_depth.vs / instanced.vs
+struct PassUniformData {
+    glm::mat4 lightSpaceMatrix;
+};
+static_assert(sizeof(PassUniformData) == 64, "PassUniformData must match the std140 PassData block");
+
+// std140 mirror of the ShadowData block in fragment.glsl. Cascade i covers view depths up to
+// splits[i]; depthBias[i] is its depth-comparison bias in that cascade's [0, 1] depth units.
+struct ShadowUniformData {
+    glm::mat4 cascadeMatrices[SHADOW_CASCADES];
+    glm::vec4 splits;
+    glm::vec4 depthBias;
+};
+static_assert(sizeof(ShadowUniformData) == 64 * SHADOW_CASCADES + 32, "ShadowUniformData must match the std140 ShadowData block");
+
+// A uniform buffer bound to a fixed binding point, rewritten whole by each update.
+template <typename T>
+class UniformBuffer
+{
+public:
+    unsigned int UBO = 0;
+
+    void create(unsigned int binding)
+    {
+        glGenBuffers(1, &UBO);
+        glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(T), nullptr, GL_DYNAMIC_DRAW);
+        glBindBufferBase(GL_UNIFORM_BUFFER, binding, UBO);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    void update(const T &data)
+    {
+        glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(T), &data);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+};
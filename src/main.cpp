@@ -12,6 +12,16 @@
 #include "Shader.h"
 #include "Camera.h"
 #include "Model.h" // new Model header
+#include "ModelLoader.h"
+#include "ModelRegistry.h"
+#include "RenderQueue.h"
+#include "ShadowCascades.h"
+#include "BVH.h"
+#include "HLOD.h"
+#include "SceneQuery.h"
+#include "EntityPool.h"
+#include "SimState.h"
+#include "TripleBuffer.h"
 
 #include <iostream>
 #include <iomanip> // print speed on console
@@ -21,13 +31,14 @@
 #include <random>
 #include <chrono>
 #include <cmath>   // acos, sqrt, etc
+#include <atomic>
+#include <thread>
 
 // Function Prototypes
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset); // Added this for orbit camera
 void processInput(GLFWwindow *window);
-bool CheckCollision(const glm::vec3& sphereCenter, float sphereRadius, const glm::vec3& boxMin, const glm::vec3& boxMax);
 
 // Window dimensions
 const unsigned int SCR_WIDTH = 1280;
@@ -54,44 +65,27 @@ bool firstMouse = true;
 bool isNightMode = false;
 
 // Timing
-float deltaTime = 0.0f;
-float lastFrame = 0.0f;
+float deltaTime = 0.0f;     // time since the last rendered frame
+double lastFrame = 0.0;
+
+// Gameplay advances in fixed steps of 1 / SIMULATION_RATE seconds, whatever the frame rate
+const double SIMULATION_RATE = 120.0;
+const int    MAX_STEPS_BEHIND = 12;       // the simulation drops time it's further behind than this
 
  // Tracking  Previous Plane Position to Calculate Direction
 glm::vec3 lastPlanePos = planePos;
 
 
 // ------------------ Enemy / Projectile system ------------------
-struct Enemy {
-    glm::vec3 pos;
-    glm::vec3 target;   // where it's currently going
-    float speed;
-    float yaw;          // orientation 
-    float propellerAngle = 0.0f;
-};
-
-struct Projectile {
-    glm::vec3 pos;
-    glm::vec3 vel;
-    float life;         // in seconds
-};
-
-struct Explosion {
-    glm::vec3 pos;
-    float life;
-    float totalLife;
-    float scale;
-};
-
-
-std::vector<Explosion> explosions; // active explosions
-std::vector<Enemy> enemies;       // active enemy planes
-std::vector<Projectile> projectiles; // active bullets
+// Structure-of-arrays pools (EntityPool.h); removal swaps the last entity into the hole
+ExplosionPool explosions;   // active explosions
+EnemyPool enemies;          // active enemy planes
+ProjectilePool projectiles; // active bullets
 
 
 float enemySpawnTimer = 0.0f;
 float enemySpawnInterval = 6.0f;   // seconds between spawns ( can be tuned to adjust)
-const int   maxEnemies = 12;           // cap number of enemies
+const int   maxEnemies = 4096;         // cap number of enemies (drawn instanced, so this is cheap)
 
 int lastMouseLeftState = GLFW_RELEASE; // to detect click -> on press
 
@@ -105,12 +99,23 @@ std::uniform_real_distribution<float> uniformRadius(300.0f, 4000.0f); // spawn d
 std::uniform_real_distribution<float> uniformSpeed(35.0f, 40.0f); // enemy speed range
 // ---------------------------------------------------------------
 
+// Point the camera orbits: the middle of the plane model rather than its origin
+glm::vec3 PlaneVisualCenter(const PlaneState &plane) {
+    glm::vec3 modelCenterOffset(0.0f, 9.0f, 3.5f);
+    return plane.pos + (plane.orientation * modelCenterOffset);
+}
+
 // GLFW Error Callback
 void glfw_error_callback(int error, const char* description) {
     std::cerr << "GLFW Error (" << error << "): " << description << std::endl;
 }
 
-int main() {
+int main(int argc, char **argv) {
+    // --packed-vertices: upload meshes as 16-byte PackedVertex instead of 32-byte Vertex
+    for (int i = 1; i < argc; i++)
+        if (std::string(argv[i]) == "--packed-vertices")
+            UsePackedVertices() = true;
+
     // Set error callback and initialize GLFW
     glfwSetErrorCallback(glfw_error_callback);
     if (!glfwInit()) {
@@ -151,6 +156,9 @@ int main() {
         return -1;
     }
     
+    // Mesh geometry is sub-allocated from shared buffers created once, here, rather than per mesh
+    MeshArena().reserve();
+
     // Configure global OpenGL state
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_CULL_FACE);
@@ -158,15 +166,26 @@ int main() {
     // Build and compile our shaders
     Shader ourShader("../src/shaders/vertex.glsl", "../src/shaders/fragment.glsl");
     Shader solidShader("../src/shaders/solid.vs", "../src/shaders/solid.fs"); //
+    Shader instancedShader("../src/shaders/instanced.vs", "../src/shaders/fragment.glsl"); // enemies, one draw per mesh
 
     // Load models: city, player plane, sun (visual, dynamic lighting), bullet (projectile) and explosion
-    Model pierModel("../src/Models/casa_city_logo.glb");
-    std::cout << "DEBUG:::" << " City model has " << pierModel.meshes.size() << " meshes." << std::endl;
-    Model planeModel("../src/Models/plane/colombian_emb_314_tucano.glb");
-    Model enemyModel("../src/Models/plane/colombian_emb_314_tucano.glb");
-    Model sunModel("../src/Models/sphere.obj");             // visual sphere used for sun / debug marker
-    Model bulletModel("../src/Models/bullet.glb");          // projectile model
-    Model explosionModel("../src/Models/explosion.glb");    // explosion model
+    // Parsing and image decoding run on worker threads; the GL uploads happen here, a few per frame.
+    // Models that haven't arrived yet are simply empty and draw nothing.
+    // The registry shares identical assets, so the enemy planes reuse the player's Tucano on the GPU.
+    ModelLoader modelLoader;
+    ModelRegistry modelRegistry(modelLoader);
+    ModelHandle planeHandle = modelRegistry.acquire("../src/Models/plane/colombian_emb_314_tucano.glb"); // player first
+    ModelHandle pierHandle = modelRegistry.acquire("../src/Models/casa_city_logo.glb");
+    ModelHandle enemyHandle = modelRegistry.acquire("../src/Models/plane/colombian_emb_314_tucano.glb");
+    ModelHandle sunHandle = modelRegistry.acquire("../src/Models/sphere.obj");             // visual sphere used for sun / debug marker
+    ModelHandle bulletHandle = modelRegistry.acquire("../src/Models/bullet.glb");          // projectile model
+    ModelHandle explosionHandle = modelRegistry.acquire("../src/Models/explosion.glb");    // explosion model
+    Model &planeModel = *planeHandle.model;
+    Model &pierModel = *pierHandle.model;
+    Model &enemyModel = *enemyHandle.model;
+    Model &sunModel = *sunHandle.model;
+    Model &bulletModel = *bulletHandle.model;
+    Model &explosionModel = *explosionHandle.model;
 
     // Define a light source position in world space
     glm::vec3 lightPos;
@@ -177,149 +196,215 @@ int main() {
 
 
     // --- Shadow Mapping Setup ---
-    const unsigned int SHADOW_WIDTH = 2048, SHADOW_HEIGHT = 2048;
-    unsigned int depthMapFBO;
-    glGenFramebuffers(1, &depthMapFBO);
-
-    // Creating depth texture
-    unsigned int depthMap;
-    glGenTextures(1, &depthMap);
-    glBindTexture(GL_TEXTURE_2D, depthMap);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-    float borderColor[] = { 1.0, 1.0, 1.0, 1.0 };
-    glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
-
-    // Attach depth texture as FBO's depth buffer
-    glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthMap, 0);
-    glDrawBuffer(GL_NONE);
-    glReadBuffer(GL_NONE);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-    // Compile the new depth shader
+    // Cascaded shadow map: SHADOW_CASCADES layers of SHADOW_RESOLUTION^2, fitted to the camera each frame
+    const unsigned int SHADOW_RESOLUTION = 2048;
+    ShadowCascades shadowCascades;
+    shadowCascades.create(SHADOW_RESOLUTION);
+
+    // Compile the new depth shader, plus an instanced one for the enemies' shadows
     Shader depthShader("../src/shaders/shadow_depth.vs", "../src/shaders/shadow_depth.fs");
+    Shader instancedDepthShader("../src/shaders/instanced.vs", "../src/shaders/shadow_depth.fs");
+
+    // Camera/lighting (FrameData), shadow pass transform (PassData) and cascade (ShadowData) blocks shared
+    // by every program. Shader binds the blocks to these points at link time. FrameData and ShadowData are
+    // written once per frame, PassData once per cascade as its pass begins.
+    UniformBuffer<FrameUniformData> frameUniforms;
+    UniformBuffer<PassUniformData> passUniforms;
+    UniformBuffer<ShadowUniformData> shadowUniforms;
+    frameUniforms.create(FRAME_UNIFORM_BINDING);
+    passUniforms.create(PASS_UNIFORM_BINDING);
+    shadowUniforms.create(SHADOW_UNIFORM_BINDING);
+
+    // Handles for the uniforms that change per object, so the hot loops skip the name lookup
+    UniformMat4 ourModelUniform = ourShader.uniformMat4("model");
+    UniformMat4 solidModelUniform = solidShader.uniformMat4("model");
+    UniformVec3 solidColorUniform = solidShader.uniformVec3("objectColor");
+    UniformMat4 depthModelUniform = depthShader.uniformMat4("model");
+    UniformInt  instanceModeUniform = instancedShader.uniformInt("instanceMode");
+    UniformInt  spinPropellerUniform = instancedShader.uniformInt("spinPropeller");
+    UniformInt  depthInstanceModeUniform = instancedDepthShader.uniformInt("instanceMode");
+    UniformInt  depthSpinPropellerUniform = instancedDepthShader.uniformInt("spinPropeller");
 
     // Set the texture units for the main shader (have to do this once)
     ourShader.use();
     ourShader.setInt("texture_diffuse1", 0);
     ourShader.setInt("shadowMap", 1);
+    instancedShader.use();
+    instancedShader.setInt("texture_diffuse1", 0);
+    instancedShader.setInt("shadowMap", 1);
+    // Same propeller offset/pivot as the player's propeller (scaled model space)
+    instancedShader.setVec3("propellerOffset", glm::vec3(0.0f, -0.1f, 1.75f));
+    instancedShader.setVec3("propellerPivot", glm::vec3(0.0f, 7.75f, 1.75f));
+    instancedDepthShader.use();
+    instancedDepthShader.setInt("depthOnly", 1);
+    instancedDepthShader.setVec3("propellerOffset", glm::vec3(0.0f, -0.1f, 1.75f));
+    instancedDepthShader.setVec3("propellerPivot", glm::vec3(0.0f, 7.75f, 1.75f));
+    // Every program that draws meshes dequantizes packed vertices when they're in use
+    for (Shader *shader : { &ourShader, &solidShader, &instancedShader, &depthShader, &instancedDepthShader })
+    {
+        shader->use();
+        shader->setInt("packedVertices", UsePackedVertices());
+    }
 
-    // Main Render loop
-    while (!glfwWindowShouldClose(window)) {
-        // Per-frame time logic
-        float currentFrame = static_cast<float>(glfwGetTime());
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
-
-        // Input
-        processInput(window);
-
-        // Render
-        glClearColor(0.1f, 0.2f, 0.3f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        // Activate shader
-        ourShader.use();
-
-        // Set uniforms that are the same for all objects
-        ourShader.setVec3("lightPos", lightPos);
-        ourShader.setVec3("viewPos", camera.Position);
-        if (isNightMode) {
-            ourShader.setVec3("lightColor", 0.4f, 0.4f, 0.6f); // soft moonlight
-            ourShader.setVec3("skyColor", 0.03f, 0.04f, 0.06f); // muted blue-gray sky
-            ourShader.setVec3("groundColor", 0.04f, 0.04f, 0.05f); // slightly brighter ground
+    // Per-frame instance data for all enemies, bullets and explosions, the enemies each shadow cascade draws
+    // and the visible enemies by level of detail (one instanced draw per level and mesh)
+    std::vector<InstanceData> enemyInstances, bulletInstances, explosionInstances;
+    InstanceBuffer bulletInstanceBuffer, explosionInstanceBuffer;
+    std::vector<InstanceData> enemyShadowInstances;
+    InstanceBuffer enemyShadowBuffers[SHADOW_CASCADES];
+    std::vector<InstanceData> enemyLodInstances[MAX_MESH_LODS];
+    InstanceBuffer enemyLodBuffers[MAX_MESH_LODS];
+
+    // Every draw of the frame is recorded here and submitted at the end, sorted by pass/shader/texture/VAO.
+    // beginPass sets up each pass's render target before its first draw.
+    RenderQueue renderQueue;
+    auto beginPass = [&](RenderPass pass) {
+        GLStateCache &gl = GLStateCache::instance();
+        if (pass < PASS_OPAQUE) {
+            // Render scene from light's point of view, one cascade per pass: first the static casters into
+            // the caches that went stale, then the cached depth plus the dynamic casters into each cascade
+            bool staticPass = pass < PASS_SHADOW;
+            int cascade = staticPass ? pass - PASS_SHADOW_STATIC : pass - PASS_SHADOW;
+            if (staticPass && !shadowCascades.staticDirty[cascade])
+                return;
+            if (staticPass)
+                shadowCascades.beginStaticCascade(cascade);
+            else
+                shadowCascades.beginCascade(cascade);
+            PassUniformData passData;
+            passData.lightSpaceMatrix = shadowCascades.matrices[cascade];
+            passUniforms.update(passData);
         } else {
-            ourShader.setVec3("lightColor", 1.0f, 1.0f, 1.0f); // bright daylight
-            ourShader.setVec3("skyColor", 0.02f, 0.03f, 0.05f); // normal sky
-            ourShader.setVec3("groundColor", 0.03f, 0.03f, 0.03f); // normal ground
+            // Reset viewport and clear for the main pass
+            gl.bindFramebuffer(0);
+            glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            gl.bindTexture2DArray(1, shadowCascades.depthArray); // shadowMap
         }
+    };
+    float statsTimer = 0.0f;
+    int staticShadowRedraws = 0;    // cascades whose static shadow cache was redrawn since the title was last updated
+
+    // Plane-vs-city collision structure, built in the background once the city has loaded
+    BVH cityBVH;
+    std::future<BVH> cityBVHBuild;
+    bool cityBVHRequested = false;
+
+    // Far-away city blocks are drawn as merged proxies (see HLOD), built as a job once the city is on the GPU
+    HLOD cityHLOD;
+    std::future<HLODData> cityHLODBuild;
+    bool cityHLODRequested = false;
+    std::vector<unsigned char> cityProxied;  // per HLOD cluster: its proxy is drawn instead of its meshes this frame
+
+    // Ray/sweep queries against the city and the enemies, cast as one batch per frame
+    SceneQuery sceneQuery;
+    sceneQuery.setStatic(&cityBVH);
+    std::vector<SceneRay> sceneRays;
+    std::vector<SceneHit> sceneHits;
+    std::vector<unsigned char> enemyKilled;   // enemies hit by a bullet this frame
+    std::vector<unsigned char> enemyBlocked;  // enemies whose way ahead is blocked by the city
+    const float enemyHitRadius = 20.0f;       // tune to change precision of hits
+    const float enemyLookAhead = 1.5f;        // seconds of flight an enemy checks for obstacles
+
+    // Frustum culling: everything is tested as a world-space box, in batches (see CullBatch).
+    // The city never moves, so its boxes are built once, when it has finished loading.
+    Frustum cameraFrustum;          // updated at the start of each frame (the cascades hold the light's)
+    BoundsBatch cityBounds, planeBounds, enemyBounds, cullBounds;
+    std::vector<unsigned char> cullVisible;
+    CullStats cullStats[PASS_COUNT];    // indexed by RenderPass
+    double cullMicroseconds = 0.0;  // time spent in CullBatch this frame
+    auto cull = [&](const Frustum &frustum, const BoundsBatch &bounds, RenderPass pass) {
+        auto start = std::chrono::high_resolution_clock::now();
+        unsigned int visibleCount = CullBatch(frustum, bounds, cullVisible);
+        cullMicroseconds += std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - start).count();
+        cullStats[pass].add((unsigned int)bounds.size(), visibleCount);
+    };
+    // Drops the instances whose box in cullBounds was culled, keeping the order of the rest
+    auto cullInstances = [&](std::vector<InstanceData> &instances) {
+        cull(cameraFrustum, cullBounds, PASS_OPAQUE);
+        size_t kept = 0;
+        for (size_t i = 0; i < instances.size(); i++)
+            if (cullVisible[i])
+                instances[kept++] = instances[i];
+        instances.resize(kept);
+    };
+
+    // Level of detail each city mesh, the plane and each enemy (by handle slot) had last frame, for the
+    // hysteresis in SelectLod. Shadow casters pick theirs from the cascade's texel size instead.
+    struct EnemyLod { uint32_t generation; int lod; };
+    std::vector<int> cityLods;
+    // The city's meshes packed into shared buffers per material, drawn with one multi-draw per material and pass
+    StaticBatch cityBatch;
+    int planeLod = -1;
+    std::vector<EnemyLod> enemyLods;
+
+    // The player's plane as the simulation leaves it after each step
+    auto capturePlane = [&]() {
+        PlaneState plane;
+        plane.pos = planePos;
+        plane.orientation = planeOrientation;
+        plane.propellerAngle = propellerAngle;
+        plane.rudderAngle = rudderAngle;
+        plane.flapAngle = flapAngle;
+        return plane;
+    };
+
+    // ------------------ SIMULATION (fixed step, own thread) ------------------
+    // Everything that moves advances here, SIMULATION_RATE times a second whatever the frame rate.
+    // From the start of the simulation thread (below) on, this state belongs to that thread: the
+    // render loop only sends it SimInput and reads back RenderState, both through triple buffers.
+    float cameraCollisionDistance = camera.Distance;
+    PlaneState previousPlane;   // before the last step
+    auto simulate = [&](const SimInput &input, float deltaTime) {
+        previousPlane = capturePlane();
+        enemies.beginStep();
+        projectiles.beginStep();
+        explosions.beginStep();
+
+        // ------------------ SCENE QUERIES (one batch per step) ------------------
+        // Camera collision, enemy line of sight and this step's bullet paths all go through a single
+        // castBatch against the city BVH and the enemy aircraft. The code below reads the results.
+        sceneQuery.clearDynamic();
+        for (uint32_t i = 0; i < enemies.size(); i++)
+            sceneQuery.addDynamic(enemies.position(i), enemyHitRadius);
+        sceneRays.clear();
+
+        SceneRay cameraRay; // from the plane back towards the eye
+        cameraRay.origin = PlaneVisualCenter(previousPlane);
+        cameraRay.direction = input.cameraDirection;
+        cameraRay.maxDistance = input.cameraDistance;
+        cameraRay.radius = 1.0f;
+        cameraRay.mask = QUERY_STATIC;
+        sceneRays.push_back(cameraRay);
+
+        size_t enemyRayStart = sceneRays.size();
+        for (uint32_t i = 0; i < enemies.size(); i++) {
+            glm::vec3 toTarget = enemies.target(i) - enemies.position(i);
+            toTarget.y = 0.0f;
+            SceneRay ray; // the enemy's own volume, swept along where it's about to fly
+            ray.origin = enemies.position(i);
+            ray.direction = glm::length(toTarget) > 0.001f ? glm::normalize(toTarget) : glm::vec3(0.0f, 0.0f, 1.0f);
+            ray.maxDistance = glm::length(toTarget) > 0.001f ? enemies.speed[i] * enemyLookAhead : 0.0f;
+            ray.radius = input.enemyRadius;
+            ray.mask = QUERY_STATIC;
+            sceneRays.push_back(ray);
+        }
+        size_t enemyRayCount = sceneRays.size() - enemyRayStart;
+
+        size_t bulletRayStart = sceneRays.size();
+        for (uint32_t i = 0; i < projectiles.size(); i++) {
+            glm::vec3 vel = projectiles.velocity(i);
+            float speed = glm::length(vel);
+            SceneRay ray;
+            ray.origin = projectiles.position(i);
+            ray.direction = speed > 1e-6f ? vel / speed : glm::vec3(0.0f, 0.0f, 1.0f);
+            ray.maxDistance = speed * deltaTime;
+            sceneRays.push_back(ray);
+        }
+        size_t bulletRayCount = sceneRays.size() - bulletRayStart;
 
-        // Set view/projection matrices (same for all objects)
-        glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 5000.0f);
-        
-        // Camera view matrix
-        glm::mat4 view = camera.GetViewMatrix();
-        ourShader.setMat4("projection", projection);
-        ourShader.setMat4("view", view);
-
-        // ======== 1. RENDER DEPTH MAP (Shadow Pass) ========
-        glm::mat4 lightProjection, lightView;
-        glm::mat4 lightSpaceMatrix;
-        float near_plane = 1.0f, far_plane = 2000.0f; 
-        // we're using an orthographic projection for a directional light like the sun
-        lightProjection = glm::ortho(-500.0f, 500.0f, -500.0f, 500.0f, near_plane, far_plane);
-        lightView = glm::lookAt(lightPos, glm::vec3(0.0f), glm::vec3(0.0, 1.0, 0.0));
-        lightSpaceMatrix = lightProjection * lightView;
-
-        // Render scene from light's point of view
-        depthShader.use();
-        depthShader.setMat4("lightSpaceMatrix", lightSpaceMatrix);
-
-        glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
-        glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-        glClear(GL_DEPTH_BUFFER_BIT);
-        // ONLY render objects that should CAST shadows.
-        glm::mat4 planeModelMatrix = glm::translate(glm::mat4(1.0f), planePos) * glm::mat4_cast(planeOrientation);
-        planeModelMatrix = glm::scale(planeModelMatrix, glm::vec3(0.05f));
-        depthShader.setMat4("model", planeModelMatrix);
-        planeModel.Draw(depthShader);
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-        // ======== 2. RENDER SCENE NORMALLY (Main Pass) ========
-        // Reset viewport
-        glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); // Clear again for the main pass
-
-        // --- Animate sun and draw the scene ---
-
-        // 1. Animate the sun to orbit the city
-        glm::mat4 modelMatrix = glm::mat4(1.0f); 
-        float orbitRadius = 400.0f;
-        float orbitSpeed = 0.015f;
-        lightPos.x = sin(glfwGetTime() * orbitSpeed) * orbitRadius;
-        lightPos.y = 1600.0f; // this is the height of the sun
-        lightPos.z = cos(glfwGetTime() * orbitSpeed) * orbitRadius;
-
-        // 2. Draw Sun model using solid color shader 
-        solidShader.use();
-        solidShader.setMat4("projection", projection);
-        solidShader.setMat4("view", view);
-        solidShader.setVec3("lightPos", lightPos); 
-        solidShader.setVec3("viewPos", camera.Position);
-        solidShader.setVec3("lightColor", 1.0f, 1.0f, 1.0f);
-        if (isNightMode)
-            solidShader.setVec3("objectColor", 0.6f, 0.6f, 0.8f); // pale moonlight
-        else
-            solidShader.setVec3("objectColor", 1.0f, 1.0f, 0.0f); // bright yellow sun
-
-        modelMatrix = glm::mat4(1.0f);
-        modelMatrix = glm::translate(modelMatrix, lightPos);
-        modelMatrix = glm::scale(modelMatrix, glm::vec3(25.0f));
-        solidShader.setMat4("model", modelMatrix);
-        sunModel.Draw(solidShader); // draw visual sun
-
-        // 3. Draw the City and Plane (using the main texture shader)
-        ourShader.use();
-        ourShader.setMat4("projection", projection);
-        ourShader.setMat4("view", view);
-
-        // put the light space matrix to main shader
-        ourShader.setMat4("lightSpaceMatrix", lightSpaceMatrix);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, depthMap);
-
-        // Draw the final City model
-        glActiveTexture(GL_TEXTURE0);
-        modelMatrix = glm::mat4(1.0f);
-        modelMatrix = glm::translate(modelMatrix, glm::vec3(0.0f, 0.0f, 0.0f));
-        modelMatrix = glm::scale(modelMatrix, glm::vec3(2.0f, 2.0f, 2.0f));      
-        ourShader.setMat4("model", modelMatrix);
-        pierModel.Draw(ourShader);
-
+        sceneQuery.castBatch(sceneRays, sceneHits);
+        cameraCollisionDistance = sceneHits[0].hit ? std::max(sceneHits[0].distance, 1.0f) : input.cameraDistance;
 
         // ------------------ ENEMY SPAWN (timer) ------------------
         enemySpawnTimer += deltaTime;
@@ -327,87 +412,30 @@ int main() {
             enemySpawnTimer = 0.0f;
             float a = uniformAngle(rng);
             float r = uniformRadius(rng);
-            Enemy e;
-            e.pos = glm::vec3(sin(a) * r, 500.0f, cos(a) * r); // spawn high
+            glm::vec3 pos(sin(a) * r, 500.0f, cos(a) * r); // spawn high
             std::uniform_real_distribution<float> off(-150.0f, 150.0f);
-            e.target = glm::vec3(off(rng), 0.0f, off(rng));
-            e.speed = uniformSpeed(rng);
-            e.yaw = 0.0f;
-            enemies.push_back(e);
-        }
-
-        // ------------------ UPDATE & DRAW ENEMIES ------------------
-        for (auto &e : enemies) {
-            glm::vec3 toTarget = e.target - e.pos;
-            toTarget.y = 0.0f; 
-            float dist = glm::length(toTarget);
-            glm::vec3 dir = (dist > 0.001f) ? glm::normalize(toTarget) : glm::vec3(0.0f);
-            
-            // This line correctly moves the enemy
-            e.pos += dir * e.speed * deltaTime;
-
-            // Pick a new target when old one is reached
-            if (dist < 20.0f) {
-                std::uniform_real_distribution<float> off(-300.0f, 300.0f);
-                e.target = glm::vec3(off(rng), 400.0f, off(rng)); // Target points at a lower heuight
-            }
-
-            // update yaw for orientation
-            if (glm::length(dir) > 0.001f) {
-                e.yaw = atan2(dir.x, dir.z);
-            }
-
-            // --- update the enemy's propeller angle ---
-            const float idlePropellerSpeed = 600.0f;
-            const float propellerSpeedMultiplier = 90.0f;
-            float currentPropellerSpeed = idlePropellerSpeed + (e.speed * propellerSpeedMultiplier);
-            e.propellerAngle += currentPropellerSpeed * deltaTime;
-            if (e.propellerAngle >= 360.0f){
-                e.propellerAngle -= 360.0f;
-            }
+            glm::vec3 target(off(rng), 0.0f, off(rng));
+            enemies.spawn(pos, target, uniformSpeed(rng));
         }
-        
-        // ------------------ DRAW ENEMIES ------------------
-        for (auto &e : enemies) {
-            glm::mat4 enemyBaseTransform = glm::translate(glm::mat4(1.0f), e.pos);
-            enemyBaseTransform *= glm::rotate(glm::mat4(1.0f), e.yaw, glm::vec3(0.0f, 1.0f, 0.0f));
-            
-            // 2. 180-degree rotation to fix the backwards movement
-            enemyBaseTransform *= glm::rotate(glm::mat4(1.0f), glm::radians(00.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-
-            // 3. enemy plane model and rotating their propeller.
-            for (Mesh &mesh : enemyModel.meshes)
-            {
-                glm::mat4 partTransform;
-
-                if (mesh.name == "Propeller_Paint_0")
-                {
-                    // Using the same offset and pivot logic here as the player's propeller.
-                    glm::vec3 propellerOffset(0.0f, -0.1f, 1.75f);
-                    glm::mat4 propellerTranslate = glm::translate(glm::mat4(1.0f), propellerOffset);
-                    glm::vec3 pivotCorrectionOffset(0.0f, 7.75f, 1.75f);
-                    glm::mat4 translateToOrigin = glm::translate(glm::mat4(1.0f), -pivotCorrectionOffset);
-                    glm::mat4 propellerSpin = glm::rotate(glm::mat4(1.0f), glm::radians(e.propellerAngle), glm::vec3(0.0f, 0.0f, 1.0f));
-                    glm::mat4 translateBack = glm::translate(glm::mat4(1.0f), pivotCorrectionOffset);
-                    glm::mat4 correctedSpin = translateBack * propellerSpin * translateToOrigin;
-                    partTransform = enemyBaseTransform * propellerTranslate * correctedSpin;
-                }
-                else
-                {
-                    // It's the enemy plane's body, so just use the base transform.
-                    partTransform = enemyBaseTransform;
-                }
 
-                // Apply final scaling and draw mesh.
-                glm::mat4 finalModelMatrix = glm::scale(partTransform, glm::vec3(0.05f));
-                ourShader.setMat4("model", finalModelMatrix);
-                mesh.Draw(ourShader);
+        // ------------------ UPDATE ENEMIES ------------------
+        // Climb while the city blocks the way ahead (line-of-sight sweep from the scene query batch),
+        // otherwise fly on towards the target. Enemies spawned this step have no query yet.
+        enemyBlocked.assign(enemies.size(), 0);
+        for (size_t i = 0; i < enemyRayCount; i++)
+            enemyBlocked[i] = sceneHits[enemyRayStart + i].hit ? 1 : 0;
+        enemies.steer(deltaTime, enemyBlocked, 20.0f);
+
+        // Pick a new target when old one is reached
+        for (uint32_t i = 0; i < enemies.size(); i++) {
+            if (enemies.reachedTarget[i]) {
+                std::uniform_real_distribution<float> off(-300.0f, 300.0f);
+                enemies.setTarget(i, glm::vec3(off(rng), 400.0f, off(rng))); // Target points at a lower heuight
             }
         }
 
         // ------------------ SHOOTING (left mouse press) ------------------
-        int curLeft = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT);
-        if (curLeft == GLFW_PRESS && lastMouseLeftState == GLFW_RELEASE) {
+        if (input.fire) {
             std::cout << "DEBUG: Fire! projectiles currently: " << projectiles.size() << std::endl;
 
             float bulletSpeed = 200.0f; // tune if needed
@@ -426,125 +454,57 @@ int main() {
 
             // spawn two bullets: left (-1) and right (+1)
             for (int sign = -1; sign <= 1; sign += 2) {
-                Projectile p;
-                p.pos = planePos
+                glm::vec3 pos = planePos
                     + planeForward * forwardOffset
                     + planeRight * (sign * wingOffset)
                     + planeUp * verticalOffset;
-                p.vel = planeForward * bulletSpeed;
-                p.life = 6.0f;
-                projectiles.push_back(p);
+                projectiles.spawn(pos, planeForward * bulletSpeed, 6.0f);
             }
         }
-        lastMouseLeftState = curLeft;
 
+        // ------------------ UPDATE PROJECTILES ------------------
+        enemyKilled.assign(enemies.size(), 0);
 
-        // ------------------ UPDATE & DRAW PROJECTILES ------------------
-        for (int i = (int)projectiles.size() - 1; i >= 0; --i) {
-            Projectile &p = projectiles[i];
-            p.pos += p.vel * deltaTime;
-            p.life -= deltaTime;
-            bool removeProj = (p.life <= 0.0f);
-
-            if (!removeProj) {
-                // draw projectile using he main textured shader so the GLB's original material shows
-                ourShader.use();
-                ourShader.setMat4("projection", projection);
-                ourShader.setMat4("view", view);
-                ourShader.setInt("unlit", 1); // unlits keeps the original color
-
-                // build orientation so model forward aligns with velocity direction
-                glm::vec3 dir = glm::normalize(p.vel);
-                if (glm::length(dir) < 1e-6f) dir = glm::vec3(0.0f, 0.0f, 1.0f);
-
-                //Replace manual quaternion math with a better lookAt method
-                // Create a rotation matrix that makes the bullet face its direction of travel coz original bullet model is sideways.
-                // glm::lookAt creates a view matrix (which aligns -Z forward). We invert it to get a model matrix.
-                glm::mat4 rot = glm::inverse(glm::lookAt(glm::vec3(0.0f), dir, glm::vec3(0.0f, 1.0f, 0.0f)));
-
-                // apply a 180-degree rotation around the Y to flip it 
-                rot = rot * glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-
-                glm::mat4 projModel = glm::mat4(1.0f);
-                projModel = glm::translate(projModel, p.pos);
-                projModel = projModel * rot;                         //orient to flight direction
-                projModel = glm::scale(projModel, glm::vec3(bulletScale)); // controlled size
-
-                ourShader.setMat4("model", projModel);
-                bulletModel.Draw(ourShader);
-
-                ourShader.setInt("unlit", 0); // reset
-            }
-
-            // Check collision with enemies (simple distance test)
-            if (!removeProj) {
-                for (int j = (int)enemies.size() - 1; j >= 0; --j) {
-                    float d = glm::length(projectiles[i].pos - enemies[j].pos);
-                    const float hitThreshold = 20.0f; // tune to change precision of hits
-                    if (d < hitThreshold) {
-                        Explosion exp;
-                        exp.pos = enemies[j].pos;
-                        exp.totalLife = 1.2f; // The total duration of the explosion in seconds
-                        exp.life = exp.totalLife; //Set current life to the total
-                        exp.scale = 0.0f; // Starting with zero scale
-                        explosions.push_back(exp);
-                        enemies.erase(enemies.begin() + j);
-                        removeProj = true;
-                        break;
-                    }
-                }
-            }
-
-            if (removeProj) {
-                projectiles.erase(projectiles.begin() + i);
-            }
-        }
-        // ------------------ UPDATE & DRAW EXPLOSIONS ------------------
-        for (int i = (int)explosions.size() - 1; i >= 0; i--) {
-            Explosion &exp = explosions[i];
-            exp.life -= deltaTime;
-            
-            if (exp.life <= 0.0f) {
-                explosions.erase(explosions.begin() + i);
+        // This step's paths were swept in the scene query batch (bullets fired this step have none).
+        // A bullet stops at the first thing it hits: an enemy explodes, a building just absorbs it.
+        for (size_t i = 0; i < bulletRayCount; i++) {
+            const SceneHit &hit = sceneHits[bulletRayStart + i];
+            if (!hit.hit || (hit.body >= 0 && enemyKilled[hit.body]))
                 continue;
+            if (hit.body >= 0) {
+                explosions.spawn(enemies.position(hit.body), 1.2f); // lasts 1.2 seconds
+                enemyKilled[hit.body] = 1;
             }
-            
-            float progress = 1.0f - (exp.life / exp.totalLife);
-            // equation : sin(0) = 0, sin(pi/2) = 1, sin(pi) = 0
-            float puffScale = sin(progress * 3.14159f);
-
-            const float maxExplosionScale = 10.30f;
-
-            ourShader.use();
-            ourShader.setMat4("projection", projection);
-            ourShader.setMat4("view", view);
-            ourShader.setInt("unlit", 1); // preserve
-            
-            glm::mat4 expModel = glm::mat4(1.0f);
-            expModel = glm::translate(expModel, exp.pos);
-            expModel = glm::scale(expModel, glm::vec3(puffScale * maxExplosionScale));
-            
-            ourShader.setMat4("model", expModel);
-            explosionModel.Draw(ourShader);
-            
-            ourShader.setInt("unlit", 0); // reset 
+            projectiles.life[i] = 0.0f;
+        }
+        projectiles.integrate(deltaTime);
+        projectiles.removeExpired();
+
+        // Enemies are removed after the hits so their body indices stay valid throughout. Going from the
+        // back, the enemy swapped into a removed one's place has already been checked.
+        for (int j = (int)enemies.size() - 1; j >= 0; --j) {
+            if (j < (int)enemyKilled.size() && enemyKilled[j])
+                enemies.remove(j);
         }
 
+        // ------------------ UPDATE EXPLOSIONS ------------------
+        explosions.age(deltaTime);
+        explosions.removeExpired();
+
         // --- FINALIZED PLANE LOGIC (with Quaternions) ---
 
         // 1.Control speed with keyboard
-        if (glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS) planeSpeed += 20.0f * deltaTime;
-        if (glfwGetKey(window, GLFW_KEY_LEFT_CONTROL) == GLFW_PRESS) planeSpeed -= 20.0f * deltaTime;
+        if (input.speedUp) planeSpeed += 20.0f * deltaTime;
+        if (input.slowDown) planeSpeed -= 20.0f * deltaTime;
         if (planeSpeed < 0.0f) planeSpeed = 0.0f;
 
-        // 2.Calculate rotation amounts for this frame
+        // 2.Calculate rotation amounts for this step
         float yawAmount = 0.0f;
         float pitchAmount = 0.0f;
-        float rollAmount = 0.0f;
-        if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) yawAmount = turnSpeed * deltaTime;
-        if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) yawAmount = -turnSpeed * deltaTime;
-        if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) pitchAmount = turnSpeed * deltaTime;
-        if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) pitchAmount = -turnSpeed * deltaTime;
+        if (input.yawLeft) yawAmount = turnSpeed * deltaTime;
+        if (input.yawRight) yawAmount = -turnSpeed * deltaTime;
+        if (input.pitchUp) pitchAmount = turnSpeed * deltaTime;
+        if (input.pitchDown) pitchAmount = -turnSpeed * deltaTime;
 
         // --- Rudder Control Logic ---
         const float maxRudderAngle = 25.0f;   // rudder's maximum turn in degrees.
@@ -599,7 +559,7 @@ int main() {
         // fix flapAngle to its limits (0 = fully retracted, maxFlapAngle = fully deployed).
         flapAngle = glm::clamp(flapAngle, minFlapAngle, maxFlapAngle);
 
-        // 3. Create small rotation quaternions for this frame's input
+        // 3. Create small rotation quaternions for this step's input
         glm::quat pitchQuat = glm::angleAxis(glm::radians(pitchAmount), glm::vec3(1.0f, 0.0f, 0.0f));
         glm::quat yawQuat = glm::angleAxis(glm::radians(yawAmount), glm::vec3(0.0f, 1.0f, 0.0f));
 
@@ -607,102 +567,488 @@ int main() {
         // applies the rotation in the plane's local space
         planeOrientation = yawQuat * planeOrientation;
         planeOrientation = planeOrientation * pitchQuat;
-        
-        // 5. Derive the TRUE forward, up, and right vectors from the orientation
-        // For this new model, nose points along its local Y-axis.
-        glm::vec3 localForward(0.0f, 0.0f, 1.0f);
-        // For this new model, canopy points along its local Z-axis.
-        glm::vec3 localUp(0.0f, 1.0f, 0.0f);
 
-        // Transform these local axes into world-space vectors using the plane's current orientation
+        // 5. Derive the TRUE forward vector from the orientation
+        // For this new model, nose points along its local Z-axis.
+        glm::vec3 localForward(0.0f, 0.0f, 1.0f);
         glm::vec3 planeForward = planeOrientation * localForward;
-        glm::vec3 planeUp = planeOrientation * localUp;
-        glm::vec3 planeRight = glm::cross(planeForward, planeUp);
-
 
         // 6.Update the plane's pos
         glm::vec3 nextPlanePos = planePos + planeForward * planeSpeed * deltaTime;
 
         // 7. Check for collisions
-        bool collisionDetected = false;
         float planeRadius = 1.5f; //Bounding sphere radius for the plane, tweak as needed
-        
-        // Define the city's transformation matrix (position and scale)
+
+        // Sphere against the city's actual triangles, through the BVH (no collisions until it's built)
+        bool collisionDetected = cityBVH.intersectsSphere(nextPlanePos, planeRadius);
+        if (!collisionDetected) {
+            planePos = nextPlanePos;
+        }
+
+        // 8. Update propeller angle for rotation
+        const float idlePropellerSpeed = 60.0f;      // The propeller's minimum spin speed (degrees per second)
+        const float propellerSpeedMultiplier = 9.0f; // How much faster the propeller spins per m/s of plane speed
+
+        // Calculate total rotation speed for this step
+        float currentPropellerSpeed = idlePropellerSpeed + (planeSpeed * propellerSpeedMultiplier);
+
+        // Update propeller's angle
+        propellerAngle += currentPropellerSpeed * deltaTime;
+        if (propellerAngle >= 360.0f) {
+            propellerAngle -= 360.0f; // Keep the angle from growing infinitely large
+        }
+    };
+
+    // Copies what the renderer needs out of the simulation (see RenderState)
+    auto captureRenderState = [&](RenderState &renderState) {
+        renderState.previousPlane = previousPlane;
+        renderState.plane = capturePlane();
+        renderState.planeSpeed = planeSpeed;
+        renderState.cameraCollisionDistance = cameraCollisionDistance;
+        renderState.raysCast = sceneQuery.raysCast;
+        renderState.dynamicCandidates = sceneQuery.dynamicCandidates;
+
+        renderState.enemies.resize(enemies.size());
+        for (uint32_t i = 0; i < enemies.size(); i++) {
+            EnemyRenderState &e = renderState.enemies[i];
+            e.handle = enemies.handles.handleAt(i);
+            e.previousPos = enemies.previousPosition(i);
+            e.pos = enemies.position(i);
+            e.previousYaw = enemies.previousYaw[i];
+            e.yaw = enemies.yaw[i];
+            e.previousPropellerAngle = enemies.previousPropellerAngle[i];
+            e.propellerAngle = enemies.propellerAngle[i];
+        }
+        renderState.projectiles.resize(projectiles.size());
+        for (uint32_t i = 0; i < projectiles.size(); i++) {
+            ProjectileRenderState &p = renderState.projectiles[i];
+            glm::vec3 vel = projectiles.velocity(i);
+            p.previousPos = projectiles.previousPosition(i);
+            p.pos = projectiles.position(i);
+            p.direction = glm::length(vel) > 1e-6f ? glm::normalize(vel) : glm::vec3(0.0f, 0.0f, 1.0f);
+        }
+        renderState.explosions.resize(explosions.size());
+        for (uint32_t i = 0; i < explosions.size(); i++) {
+            ExplosionRenderState &x = renderState.explosions[i];
+            x.pos = explosions.position(i);
+            x.previousProgress = explosions.previousProgress(i);
+            x.progress = explosions.progress(i);
+        }
+    };
+
+    // Start flying as soon as the player's plane is on the GPU; the rest streams in.
+    modelLoader.waitFor(planeHandle);
+    const double simStep = 1.0 / SIMULATION_RATE;
+    TripleBuffer<SimInput> simInputs;
+    TripleBuffer<RenderState> renderStates;
+    previousPlane = capturePlane();
+    captureRenderState(renderStates.write());
+    renderStates.write().time = glfwGetTime();
+    renderStates.publish();
+    renderStates.acquire();
+
+    // The simulation thread runs the steps while the loop below renders the newest finished one, so
+    // a frame costs about max(simulation, rendering) rather than both. It takes the latest SimInput
+    // before each batch of steps and publishes a RenderState after it, then sleeps until the next step
+    // is due. Running more than MAX_STEPS_BEHIND steps late (a stall), it drops the backlog.
+    std::atomic<bool> simRunning(true);
+    std::thread simThread([&]() {
+        SimInput input;
+        unsigned int firesSeen = 0;
+        double simTime = glfwGetTime();
+        while (simRunning.load(std::memory_order_acquire)) {
+            if (simInputs.acquire())
+                input = simInputs.read();
+
+            // Once the city is on the GPU its collision BVH is built as a job, in world space
+            // (same transform the city is drawn with). The shared_ptr keeps the model alive for the build.
+            if (!cityBVHRequested && input.city) {
+                cityBVHRequested = true;
+                std::shared_ptr<Model> city = input.city;
+                cityBVHBuild = JobSystem::instance().async([city] {
+                    glm::mat4 cityModelMatrix = glm::mat4(1.0f);
+                    cityModelMatrix = glm::translate(cityModelMatrix, glm::vec3(0.0f, 0.0f, 0.0f));
+                    cityModelMatrix = glm::scale(cityModelMatrix, glm::vec3(2.0f, 2.0f, 2.0f));
+                    BVH bvh;
+                    bvh.build(*city, cityModelMatrix);
+                    return bvh;
+                });
+            }
+            if (cityBVHBuild.valid() && cityBVHBuild.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+                cityBVH = cityBVHBuild.get();
+                cityBVH.printStats("city");
+            }
+
+            double now = glfwGetTime();
+            simTime = std::max(simTime, now - simStep * MAX_STEPS_BEHIND);
+            int steps = 0;
+            auto start = std::chrono::high_resolution_clock::now();
+            while (simTime + simStep <= now) {
+                input.fire = input.fireCount != firesSeen; // one volley per click, not per step
+                firesSeen = input.fireCount;
+                simulate(input, (float)simStep);
+                simTime += simStep;
+                steps++;
+            }
+            if (steps > 0) {
+                RenderState &state = renderStates.write();
+                captureRenderState(state);
+                state.time = simTime;
+                state.stepMicroseconds = (float)(std::chrono::duration<double, std::micro>(
+                    std::chrono::high_resolution_clock::now() - start).count() / steps);
+                renderStates.publish();
+            }
+            std::this_thread::sleep_for(std::chrono::duration<double>(simTime + simStep - glfwGetTime()));
+        }
+    });
+
+    lastFrame = glfwGetTime();
+    unsigned int fireCount = 0;
+
+    // Main Render loop
+    while (!glfwWindowShouldClose(window)) {
+        // Per-frame time logic
+        double currentFrame = glfwGetTime();
+        deltaTime = static_cast<float>(currentFrame - lastFrame);
+        lastFrame = currentFrame;
+
+        // Upload any models whose load jobs have finished (bounded so a frame doesn't stall)
+        if (modelLoader.pending() > 0)
+        {
+            modelLoader.uploadFinished(4.0);
+            if (modelLoader.pending() == 0)
+            {
+                modelRegistry.printStats();
+                TextureCache::instance().printStats();
+                MeshArena().printStats();
+            }
+        }
+        // Free models whose last handle has been dropped (the loop's own handles live until exit)
+        else if (modelRegistry.purgeUnused() > 0)
+        {
+            modelRegistry.printStats();
+            MeshArena().printStats();
+        }
+
+        // Input, handed to the simulation thread
+        processInput(window);
+        int curLeft = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT);
+        if (curLeft == GLFW_PRESS && lastMouseLeftState == GLFW_RELEASE)
+            fireCount++;
+        lastMouseLeftState = curLeft;
+        SimInput &input = simInputs.write();
+        input.speedUp = glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS;
+        input.slowDown = glfwGetKey(window, GLFW_KEY_LEFT_CONTROL) == GLFW_PRESS;
+        input.yawLeft = glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS;
+        input.yawRight = glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS;
+        input.pitchUp = glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS;
+        input.pitchDown = glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS;
+        input.fireCount = fireCount;
+        input.cameraDirection = camera.OrbitDirection();
+        input.cameraDistance = camera.Distance;
+        input.enemyRadius = enemyModel.boundingRadius() * 0.05f * 1.25f;
+        if (pierHandle.ready())
+            input.city = pierHandle.owner;
+        simInputs.publish();
+
+        // Newest simulation state, and how far past its step this frame falls
+        renderStates.acquire();
+        const RenderState &renderState = renderStates.read();
+        float alpha = glm::clamp((float)((currentFrame - renderState.time) / simStep), 0.0f, 1.0f);
+        PlaneState plane = LerpPlane(renderState.previousPlane, renderState.plane, alpha);
+        camera.Target = PlaneVisualCenter(plane);
+        camera.CollisionDistance = renderState.cameraCollisionDistance;
+
+        // Render (the passes clear their own targets, see beginPass)
+        glClearColor(0.1f, 0.2f, 0.3f, 1.0f);
+
+        // Animate the sun to orbit the city. Done first so the shadow pass and lighting agree this frame.
+        float orbitRadius = 400.0f;
+        float orbitSpeed = 0.015f;
+        lightPos.x = sin(glfwGetTime() * orbitSpeed) * orbitRadius;
+        lightPos.y = 1600.0f; // this is the height of the sun
+        lightPos.z = cos(glfwGetTime() * orbitSpeed) * orbitRadius;
+
+        // View/projection matrices (same for all objects)
+        const float fovY = glm::radians(45.0f), aspect = (float)SCR_WIDTH / (float)SCR_HEIGHT;
+        const float nearPlane = 0.1f, farPlane = 5000.0f;
+        glm::mat4 projection = glm::perspective(fovY, aspect, nearPlane, farPlane);
+
+        // Screen pixels per world unit on a sphere (center, radius), at its point nearest to the camera
+        const float pixelsPerUnitAtOne = SCR_HEIGHT / (2.0f * std::tan(fovY * 0.5f));
+        auto pixelsPerUnit = [&](const glm::vec3 &center, float radius) {
+            return pixelsPerUnitAtOne / std::max(glm::length(center - camera.Position) - radius, nearPlane);
+        };
+
+        // Camera view matrix
+        glm::mat4 view = camera.GetViewMatrix();
+        renderQueue.begin(camera.Position);
+        cameraFrustum = camera.GetFrustum(projection);
+        for (CullStats &stats : cullStats)
+            stats = CullStats();
+        cullMicroseconds = 0.0;
+
+        // Uniforms that are the same for all objects and every program: one upload per frame
+        FrameUniformData frameData;
+        frameData.projection = projection;
+        frameData.view = view;
+        frameData.viewPos = camera.Position;
+        frameData.lightPos = lightPos;
+        if (isNightMode) {
+            frameData.lightColor = glm::vec3(0.4f, 0.4f, 0.6f); // soft moonlight
+            frameData.skyColor = glm::vec3(0.03f, 0.04f, 0.06f); // muted blue-gray sky
+            frameData.groundColor = glm::vec3(0.04f, 0.04f, 0.05f); // slightly brighter ground
+        } else {
+            frameData.lightColor = glm::vec3(1.0f, 1.0f, 1.0f); // bright daylight
+            frameData.skyColor = glm::vec3(0.02f, 0.03f, 0.05f); // normal sky
+            frameData.groundColor = glm::vec3(0.03f, 0.03f, 0.03f); // normal ground
+        }
+        frameUniforms.update(frameData);
+
+        // ======== 1. RENDER DEPTH MAP (Shadow Pass) ========
+        // The sun is treated as a directional light shining from lightPos towards the city's origin.
+        // Every cascade culls the casters against its own light frustum. The city is static: it's only
+        // drawn into the cascades whose cached depth went stale (see ShadowCascades); the plane and the
+        // enemies are drawn every frame on top of a copy of that cache.
+        // City boxes (the city never moves, so they're built once it has loaded)
         glm::mat4 cityModelMatrix = glm::mat4(1.0f);
         cityModelMatrix = glm::translate(cityModelMatrix, glm::vec3(0.0f, 0.0f, 0.0f));
         cityModelMatrix = glm::scale(cityModelMatrix, glm::vec3(2.0f, 2.0f, 2.0f));
+        if (cityBounds.size() != pierModel.meshes.size()) {
+            cityBounds.clear();
+            for (Mesh &mesh : pierModel.meshes)
+                cityBounds.addTransformed(mesh.minAABB, mesh.maxAABB, cityModelMatrix);
+            cityLods.assign(pierModel.meshes.size(), -1);
+            cityBatch.build(pierModel);
+            shadowCascades.invalidateStatic();
+        }
+        cityBatch.begin(PASS_COUNT);
+        // HLOD proxies: the textures are read back here, the rest is a job; the GL half runs once it's done
+        if (!cityHLODRequested && pierHandle.ready()) {
+            cityHLODRequested = true;
+            std::shared_ptr<Model> city = pierHandle.owner;
+            std::shared_ptr<std::vector<HLODTile>> tiles = std::make_shared<std::vector<HLODTile>>(HLOD::CaptureTiles(*city));
+            cityHLODBuild = JobSystem::instance().async([city, tiles] { return HLOD::Build(*city, *tiles); });
+        }
+        if (cityHLODBuild.valid() && cityHLODBuild.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            HLODData data = cityHLODBuild.get();
+            cityHLOD.upload(data, pierModel, 2.0f, pixelsPerUnitAtOne);
+            shadowCascades.invalidateStatic();
+        }
+        shadowCascades.update(view, fovY, aspect, nearPlane, farPlane, -lightPos);
+        shadowUniforms.update(shadowCascades.uniformData());
+        staticShadowRedraws += shadowCascades.staticRefreshes;
+
+        // Enemy instances and bounds, shared by the shadow cascades and the main pass below.
+        // Their bounds (enemyRadius) are a sphere around the origin (they only yaw), padded for the moved propeller.
+        float enemyRadius = enemyModel.boundingRadius() * 0.05f * 1.25f;
+        enemyInstances.clear();
+        enemyBounds.clear();
+        for (const EnemyRenderState &e : renderState.enemies) {
+            glm::vec3 pos = glm::mix(e.previousPos, e.pos, alpha);
+            InstanceData instance;
+            instance.posScale = glm::vec4(pos, 0.05f);
+            instance.params = glm::vec4(LerpAngle(e.previousYaw, e.yaw, alpha, 2.0f * 3.14159265f),
+                                        LerpAngle(e.previousPropellerAngle, e.propellerAngle, alpha, 360.0f), 0.0f, 0.0f);
+            enemyInstances.push_back(instance);
+            enemyBounds.addSphere(pos, enemyRadius);
+        }
 
-        for (const auto& mesh : pierModel.meshes) {
-
-            // --- Ignore any mesh that is unrealistically large ---
-            if ((mesh.maxAABB.y - mesh.minAABB.y) > 100.0f) continue;
+        // ONLY render objects that should CAST shadows: the city, the player's plane and the enemies
+        glm::mat4 planeModelMatrix = glm::translate(glm::mat4(1.0f), plane.pos) * glm::mat4_cast(plane.orientation);
+        planeModelMatrix = glm::scale(planeModelMatrix, glm::vec3(0.05f));
+        planeBounds.clear();
+        for (Mesh &mesh : planeModel.meshes)
+            planeBounds.addTransformed(mesh.minAABB, mesh.maxAABB, planeModelMatrix);
+        for (int cascade = 0; cascade < SHADOW_CASCADES; cascade++) {
+            const Frustum &lightFrustum = shadowCascades.frustums[cascade];
+            float shadowPixelsPerUnit = 1.0f / shadowCascades.texelSize[cascade];   // shadow texels, really
+            if (shadowCascades.staticDirty[cascade]) {
+                // HLOD proxies replace their clusters wherever their error is below a shadow texel
+                RenderPass staticPass = (RenderPass)(PASS_SHADOW_STATIC + cascade);
+                cityProxied.assign(cityHLOD.clusters.size(), 0);
+                for (size_t c = 0; c < cityHLOD.clusters.size(); c++) {
+                    if (!cityHLOD.useProxyInShadow((int)c, shadowCascades.texelSize[cascade]))
+                        continue;
+                    cityProxied[c] = 1;
+                    Mesh &proxy = cityHLOD.proxies[c];
+                    glm::vec3 center, extent;
+                    TransformAABB(proxy.minAABB, proxy.maxAABB, cityModelMatrix, center, extent);
+                    bool visible = lightFrustum.intersects(center, extent);
+                    cullStats[staticPass].add(1, visible ? 1 : 0);
+                    if (visible)
+                        renderQueue.draw(staticPass, depthShader, proxy, depthModelUniform, cityModelMatrix);
+                }
+                cull(lightFrustum, cityBounds, staticPass);
+                for (size_t i = 0; i < pierModel.meshes.size(); i++) {
+                    if (!cullVisible[i] || (cityHLOD.ready() && cityProxied[cityHLOD.clusterOf[i]]))
+                        continue;
+                    cityBatch.add(staticPass, i, pierModel.meshes[i].selectLod(2.0f * shadowPixelsPerUnit));
+                }
+                renderQueue.drawBatch(staticPass, depthShader, cityBatch, depthModelUniform, cityModelMatrix);
+            }
 
-            // Transform the mesh's local AABB corners into world space
-            glm::vec3 worldMin = cityModelMatrix * glm::vec4(mesh.minAABB, 1.0f);
-            glm::vec3 worldMax = cityModelMatrix * glm::vec4(mesh.maxAABB, 1.0f);
+            RenderPass pass = (RenderPass)(PASS_SHADOW + cascade);
+            int planeShadowLod = planeModel.selectLod(0.05f * shadowPixelsPerUnit);
+            cull(lightFrustum, planeBounds, pass);
+            for (size_t i = 0; i < planeModel.meshes.size(); i++)
+                if (cullVisible[i])
+                    renderQueue.draw(pass, depthShader, planeModel.meshes[i], depthModelUniform, planeModelMatrix, planeShadowLod);
+
+            cull(lightFrustum, enemyBounds, pass);
+            enemyShadowInstances.clear();
+            for (size_t i = 0; i < enemyInstances.size(); i++)
+                if (cullVisible[i])
+                    enemyShadowInstances.push_back(enemyInstances[i]);
+            if (!enemyShadowInstances.empty()) {
+                enemyShadowBuffers[cascade].upload(enemyShadowInstances);
+                int enemyShadowLod = enemyModel.selectLod(0.05f * shadowPixelsPerUnit);
+                for (Mesh &mesh : enemyModel.meshes) {
+                    renderQueue.drawInstanced(pass, instancedDepthShader, mesh, enemyShadowBuffers[cascade], enemyShadowLod)
+                        .setInt(depthInstanceModeUniform, INSTANCE_AIRCRAFT)
+                        .setInt(depthSpinPropellerUniform, mesh.name == "Propeller_Paint_0" ? 1 : 0);
+                }
+            }
+        }
 
-            // IMPORTANT: must ensure min is actually min and max is max after transformation
-            glm::vec3 realMin = glm::min(worldMin, worldMax);
-            glm::vec3 realMax = glm::max(worldMin, worldMax);
+        // ======== 2. RENDER SCENE NORMALLY (Main Pass) ========
+        // --- Draw the scene ---
+        glm::mat4 modelMatrix;
 
-            glm::vec3 boxSize = realMax - realMin;
-            if (boxSize.y > 20.0f) { //Only print for objects taller than 20 units
-                // std::cout << "DEBUG::: " << "Found a very large mesh! Size: Y = " << boxSize.y << std::endl;
-            }
+        // 1. Draw Sun model using solid color shader
+        glm::vec3 sunColor = isNightMode ? glm::vec3(0.6f, 0.6f, 0.8f)   // pale moonlight
+                                         : glm::vec3(1.0f, 1.0f, 0.0f);  // bright yellow sun
+        modelMatrix = glm::mat4(1.0f);
+        modelMatrix = glm::translate(modelMatrix, lightPos);
+        modelMatrix = glm::scale(modelMatrix, glm::vec3(25.0f));
+        bool sunVisible = cameraFrustum.intersectsSphere(lightPos, sunModel.boundingRadius() * 25.0f);
+        cullStats[PASS_OPAQUE].add(1, sunVisible ? 1 : 0);
+        if (sunVisible) {
+            for (Mesh &mesh : sunModel.meshes) // draw visual sun
+                renderQueue.draw(PASS_OPAQUE, solidShader, mesh, solidModelUniform, modelMatrix).setVec3(solidColorUniform, sunColor);
+        }
 
-            if (CheckCollision(nextPlanePos, planeRadius, realMin, realMax)) {
-                collisionDetected = true;
-                break; // A collision was found so no need to check other meshes
+        // 2. Draw the City and Plane (using the main texture shader)
+        // Draw the final City model: far clusters as their HLOD proxy (one draw each), the rest mesh by mesh
+        cityProxied.assign(cityHLOD.clusters.size(), 0);
+        for (size_t c = 0; c < cityHLOD.clusters.size(); c++) {
+            Mesh &proxy = cityHLOD.proxies[c];
+            glm::vec3 center, extent;
+            TransformAABB(proxy.minAABB, proxy.maxAABB, cityModelMatrix, center, extent);
+            float distance = glm::length(glm::max(glm::abs(camera.Position - center) - extent, glm::vec3(0.0f)));
+            if (!cityHLOD.useProxy((int)c, distance))
+                continue;
+            cityProxied[c] = 1;
+            bool visible = cameraFrustum.intersects(center, extent);
+            cullStats[PASS_OPAQUE].add(1, visible ? 1 : 0);
+            if (visible)
+                renderQueue.draw(PASS_OPAQUE, ourShader, proxy, ourModelUniform, cityModelMatrix);
+        }
+        cull(cameraFrustum, cityBounds, PASS_OPAQUE);
+        for (size_t i = 0; i < pierModel.meshes.size(); i++) {
+            if (!cullVisible[i] || (cityHLOD.ready() && cityProxied[cityHLOD.clusterOf[i]]))
+                continue;
+            Mesh &mesh = pierModel.meshes[i];
+            glm::vec3 center = glm::vec3(cityModelMatrix * glm::vec4(0.5f * (mesh.minAABB + mesh.maxAABB), 1.0f));
+            float radius = glm::length(mesh.maxAABB - mesh.minAABB); // half the diagonal, times the city's scale of 2
+            cityLods[i] = mesh.selectLod(2.0f * pixelsPerUnit(center, radius), cityLods[i]);
+            cityBatch.add(PASS_OPAQUE, i, cityLods[i]);
+        }
+        renderQueue.drawBatch(PASS_OPAQUE, ourShader, cityBatch, ourModelUniform, cityModelMatrix);
+
+        // ------------------ DRAW ENEMIES (instanced) ------------------
+        // Visible enemies go into one instance buffer per level of detail; each enemy mesh is then drawn
+        // once per level for all of them. The propeller spin happens in instanced.vs.
+        // (enemyInstances and enemyBounds were filled for the shadow pass)
+        cull(cameraFrustum, enemyBounds, PASS_OPAQUE);
+        for (std::vector<InstanceData> &instances : enemyLodInstances)
+            instances.clear();
+        for (size_t i = 0; i < enemyInstances.size(); i++) {
+            if (!cullVisible[i])
+                continue;
+            const EntityHandle &handle = renderState.enemies[i].handle;
+            if (handle.slot >= enemyLods.size())
+                enemyLods.resize(handle.slot + 1, EnemyLod{ UINT32_MAX, -1 });
+            EnemyLod &lod = enemyLods[handle.slot];
+            if (lod.generation != handle.generation)
+                lod = EnemyLod{ handle.generation, -1 };   // a new enemy in a reused slot
+            glm::vec3 pos = glm::vec3(enemyInstances[i].posScale);
+            lod.lod = enemyModel.selectLod(0.05f * pixelsPerUnit(pos, enemyRadius), lod.lod);
+            enemyLodInstances[lod.lod].push_back(enemyInstances[i]);
+        }
+        for (int lod = 0; lod < MAX_MESH_LODS; lod++) {
+            if (enemyLodInstances[lod].empty())
+                continue;
+            enemyLodBuffers[lod].upload(enemyLodInstances[lod]);
+            for (Mesh &mesh : enemyModel.meshes) {
+                renderQueue.drawInstanced(PASS_OPAQUE, instancedShader, mesh, enemyLodBuffers[lod], lod)
+                    .setInt(instanceModeUniform, INSTANCE_AIRCRAFT)
+                    .setInt(spinPropellerUniform, mesh.name == "Propeller_Paint_0" ? 1 : 0);
             }
+        }
 
-            
+        // ------------------ DRAW PROJECTILES (instanced) ------------------
+        // instanced.vs builds the orientation basis from the direction, so there's no matrix inverse per bullet
+        float bulletRadius = bulletModel.boundingRadius() * bulletScale;
+        bulletInstances.clear();
+        cullBounds.clear();
+        for (const ProjectileRenderState &p : renderState.projectiles) {
+            glm::vec3 pos = glm::mix(p.previousPos, p.pos, alpha);
+            InstanceData instance;
+            instance.posScale = glm::vec4(pos, bulletScale); // controlled size
+            instance.params = glm::vec4(p.direction, 0.0f);
+            bulletInstances.push_back(instance);
+            cullBounds.addSphere(pos, bulletRadius);
         }
+        cullInstances(bulletInstances);
 
+        // ------------------ DRAW EXPLOSIONS (instanced) ------------------
+        float explosionRadius = explosionModel.boundingRadius();
+        explosionInstances.clear();
+        cullBounds.clear();
+        for (const ExplosionRenderState &x : renderState.explosions) {
+            // equation : sin(0) = 0, sin(pi/2) = 1, sin(pi) = 0
+            float progress = glm::mix(x.previousProgress, x.progress, alpha);
+            float puffScale = sin(progress * 3.14159f);
 
-        // 8. Build the final model matrix for rendering
+            const float maxExplosionScale = 10.30f;
 
-        if (!collisionDetected) {
-            planePos = nextPlanePos;
+            InstanceData instance;
+            instance.posScale = glm::vec4(x.pos, puffScale * maxExplosionScale);
+            instance.params = glm::vec4(0.0f);
+            explosionInstances.push_back(instance);
+            cullBounds.addSphere(x.pos, explosionRadius * instance.posScale.w);
         }
-        // camera.Target = planePos;
 
+        cullInstances(explosionInstances);
 
-        // --- CAMERA TARGET FIX ---
-        glm::vec3 modelCenterOffset(0.0f, 9.0f, 3.5f); 
-        glm::vec3 visualCenter = planePos + (planeOrientation * modelCenterOffset);
-        camera.Target = visualCenter;
+        // One instanced draw per bullet/explosion mesh, using the GLB's original material
+        if (!bulletInstances.empty()) {
+            bulletInstanceBuffer.upload(bulletInstances);
+            for (Mesh &mesh : bulletModel.meshes)
+                renderQueue.drawInstanced(PASS_OPAQUE, instancedShader, mesh, bulletInstanceBuffer)
+                    .setInt(instanceModeUniform, INSTANCE_PROJECTILE)
+                    .setInt(spinPropellerUniform, 0);
+        }
+        if (!explosionInstances.empty()) {
+            explosionInstanceBuffer.upload(explosionInstances);
+            for (Mesh &mesh : explosionModel.meshes)
+                renderQueue.drawInstanced(PASS_OPAQUE, instancedShader, mesh, explosionInstanceBuffer)
+                    .setInt(instanceModeUniform, INSTANCE_EXPLOSION)
+                    .setInt(spinPropellerUniform, 0);
+        }
 
         // Draw a small green marker at camera.Target using sunModel (keeps sunModel in the project)
-        solidShader.use();
-        solidShader.setMat4("projection", projection);
-        solidShader.setMat4("view", view);
-        solidShader.setVec3("objectColor", 0.0f, 1.0f, 0.0f); // Bright Green
-
         modelMatrix = glm::mat4(1.0f);
         modelMatrix = glm::translate(modelMatrix, camera.Target);
         modelMatrix = glm::scale(modelMatrix, glm::vec3(0.5f)); // Make it small
-        solidShader.setMat4("model", modelMatrix);
-        
-        sunModel.Draw(solidShader); // Draw the green marker with the sphere model
-        
-        // Switch back to the main shader for the plane
-        ourShader.use();
+        for (Mesh &mesh : sunModel.meshes) // Draw the green marker with the sphere model
+            renderQueue.draw(PASS_OPAQUE, solidShader, mesh, solidModelUniform, modelMatrix)
+                .setVec3(solidColorUniform, glm::vec3(0.0f, 1.0f, 0.0f)); // Bright Green
         // --------------------------------------------------------
-        // 9. Update propeller angle for rotation
-        const float idlePropellerSpeed = 60.0f;      // The propeller's minimum spin speed (degrees per second)
-        const float propellerSpeedMultiplier = 9.0f; // How much faster the propeller spins per m/s of plane speed
-
-        // Calculate total rotation speed for this frame
-        float currentPropellerSpeed = idlePropellerSpeed + (planeSpeed * propellerSpeedMultiplier);
-
-        // Update propeller's angle
-        propellerAngle += currentPropellerSpeed * deltaTime;
-        if (propellerAngle >= 360.0f) {
-            propellerAngle -= 360.0f; // Keep the angle from growing infinitely large
-        }
 
         // 10. Define the plane's base transformation for the current frame
-        glm::mat4 planeBaseTransform = glm::translate(glm::mat4(1.0f), planePos) * glm::mat4_cast(planeOrientation);
+        glm::mat4 planeBaseTransform = glm::translate(glm::mat4(1.0f), plane.pos) * glm::mat4_cast(plane.orientation);
 
 
         // // MESH NAMES OF THE PLANE MODEL
@@ -714,7 +1060,8 @@ int main() {
         // std::cout << "-------------------------------------\n" << std::endl;
 
 
-        // 11. Draw each part of the model with its correct transformation now
+        // 11. Draw each part of the model with its correct transformation now, all at the same level of detail
+        planeLod = planeModel.selectLod(0.05f * pixelsPerUnit(plane.pos, planeModel.boundingRadius() * 0.05f), planeLod);
         for (Mesh &mesh : planeModel.meshes)
         {
             glm::mat4 partTransform;
@@ -729,7 +1076,7 @@ int main() {
                 // --- Pivot correction ---
                 glm::vec3 pivotCorrectionOffset(0.0f, 7.75f, 1.75f); 
                 glm::mat4 translateToOrigin = glm::translate(glm::mat4(1.0f), -pivotCorrectionOffset);
-                glm::mat4 propellerSpin = glm::rotate(glm::mat4(1.0f), glm::radians(propellerAngle), glm::vec3(0.0f, 0.0f, 1.0f));
+                glm::mat4 propellerSpin = glm::rotate(glm::mat4(1.0f), glm::radians(plane.propellerAngle), glm::vec3(0.0f, 0.0f, 1.0f));
                 glm::mat4 translateBack = glm::translate(glm::mat4(1.0f), pivotCorrectionOffset);
                 glm::mat4 correctedSpin = translateBack * propellerSpin * translateToOrigin;
 
@@ -745,7 +1092,7 @@ int main() {
                 glm::mat4 translateToModelOrigin = glm::translate(glm::mat4(1.0f), -rudderPivot);
 
                 // 3.The rudder yaws around the plane's local Y-axis
-                glm::mat4 rudderRotation = glm::rotate(glm::mat4(1.0f), glm::radians(rudderAngle), glm::vec3(0.0f, 1.0f, 0.0f));
+                glm::mat4 rudderRotation = glm::rotate(glm::mat4(1.0f), glm::radians(plane.rudderAngle), glm::vec3(0.0f, 1.0f, 0.0f));
 
                 // 4.The final local transformation for the rudder
                 partTransform = planeBaseTransform * translateToPivot * rudderRotation * translateToModelOrigin;
@@ -766,7 +1113,7 @@ int main() {
                 glm::mat4 translateToModelOrigin = glm::translate(glm::mat4(1.0f), -flapPivot);
 
                 //Flaps pitch around the plane's local X-axis.
-                glm::mat4 flapRotation = glm::rotate(glm::mat4(1.0f), glm::radians(flapAngle), glm::vec3(1.0f, 0.0f, 0.0f));
+                glm::mat4 flapRotation = glm::rotate(glm::mat4(1.0f), glm::radians(plane.flapAngle), glm::vec3(1.0f, 0.0f, 0.0f));
 
                 //Combine the matrices to create the final local transformation.
                 partTransform = planeBaseTransform * translateToPivot * flapRotation * translateToModelOrigin;
@@ -779,12 +1126,54 @@ int main() {
 
             // 12. Apply final scaling and draw the mesh.
             glm::mat4 finalModelMatrix = glm::scale(partTransform, glm::vec3(0.05f));
-            ourShader.setMat4("model", finalModelMatrix);
-            mesh.Draw(ourShader);
+            glm::vec3 partCenter, partExtent;
+            TransformAABB(mesh.minAABB, mesh.maxAABB, finalModelMatrix, partCenter, partExtent);
+            bool partVisible = cameraFrustum.intersects(partCenter, partExtent);
+            cullStats[PASS_OPAQUE].add(1, partVisible ? 1 : 0);
+            if (partVisible)
+                renderQueue.draw(PASS_OPAQUE, ourShader, mesh, ourModelUniform, finalModelMatrix, planeLod);
+        }
+
+        // Submit the frame: shadow pass, then main pass, each sorted to minimise state changes
+        renderQueue.execute(beginPass);
+
+        // Draw-call, state-change, culling and job counters of this frame, in the title twice a second
+        GLStateCache::instance().endFrame();
+        JobSystem::instance().endFrame();
+        statsTimer += deltaTime;
+        if (statsTimer >= 0.5f) {
+            statsTimer = 0.0f;
+            const GLStateCache::Counters &stats = GLStateCache::instance().lastFrame();
+            const JobSystem::FrameTrace &jobs = JobSystem::instance().lastFrame();
+            CullStats shadowCull;   // all cascades, static and dynamic casters
+            for (int pass = PASS_SHADOW_STATIC; pass < PASS_OPAQUE; pass++)
+                shadowCull.add(cullStats[pass].tested, cullStats[pass].visible);
+            std::string lodTriangles;   // e.g. "812k/95k/40k/6k", all passes
+            for (int lod = 0; lod < MAX_MESH_LODS; lod++)
+                lodTriangles += (lod ? "/" : "") + std::to_string((stats.lodTriangles[lod] + 500) / 1000) + "k";
+            std::string title = "City Scene | " + std::to_string(stats.drawCalls) + " draws ("
+                + std::to_string(stats.instancedDrawCalls) + " instanced, "
+                + std::to_string(stats.multiDrawCalls) + " multi-draws of " + std::to_string(stats.multiDrawRanges) + " meshes), "
+                + std::to_string(stats.stateChanges()) + " state changes, "
+                + std::to_string(stats.redundantSkipped) + " redundant binds skipped, triangles by LOD "
+                + lodTriangles + ", " + std::to_string(std::count(cityProxied.begin(), cityProxied.end(), 1)) + "/"
+                + std::to_string(cityHLOD.clusters.size()) + " city clusters as proxies | culled "
+                + std::to_string(cullStats[PASS_OPAQUE].culled()) + "/" + std::to_string(cullStats[PASS_OPAQUE].tested) + " main, "
+                + std::to_string(shadowCull.culled()) + "/" + std::to_string(shadowCull.tested) + " shadow in "
+                + std::to_string((int)cullMicroseconds) + " us, "
+                + std::to_string(staticShadowRedraws) + " static shadow redraws | "
+                + std::to_string(renderState.raysCast) + " scene queries, "
+                + std::to_string(renderState.dynamicCandidates) + " hit candidates per step | sim "
+                + std::to_string((int)renderState.stepMicroseconds) + " us/step, frame "
+                + std::to_string((int)(deltaTime * 1000000.0f)) + " us | workers "
+                + JobSystem::instance().traceSummary() + " busy, "
+                + std::to_string(jobs.jobs) + " jobs, " + std::to_string(jobs.steals) + " steals";
+            glfwSetWindowTitle(window, title.c_str());
+            staticShadowRedraws = 0;
         }
 
 
-        std::cout << "Plane Speed: " << std::fixed << std::setprecision(1) << planeSpeed << " m/s\r";
+        std::cout << "Plane Speed: " << std::fixed << std::setprecision(1) << renderState.planeSpeed << " m/s\r";
 
 
         // Swap buffers and poll IO events
@@ -793,10 +1182,10 @@ int main() {
         
     }
 
+    // Stop the simulation before the state it uses goes away
+    simRunning.store(false, std::memory_order_release);
+    simThread.join();
 
-
-    
-    
     glfwTerminate();
     return 0;
 }
@@ -844,25 +1233,6 @@ void mouse_callback(GLFWwindow* window, double xposIn, double yposIn) {
     camera.ProcessMouseMovement(xoffset, yoffset);
 }
 
-bool CheckCollision(const glm::vec3& sphereCenter, float sphereRadius, const glm::vec3& boxMin, const glm::vec3& boxMax) {
-    // Get the closest point on AABB to the sphere's center
-    float x = std::max(boxMin.x, std::min(sphereCenter.x, boxMax.x));
-    float y = std::max(boxMin.y, std::min(sphereCenter.y, boxMax.y));
-    float z = std::max(boxMin.z, std::min(sphereCenter.z, boxMax.z));
-
-    // Calculate the distance between the closest point and sphere's center
-    float distance = std::sqrt(
-        (x - sphereCenter.x) * (x - sphereCenter.x) +
-        (y - sphereCenter.y) * (y - sphereCenter.y) +
-        (z - sphereCenter.z) * (z - sphereCenter.z)
-    );
-
-    // If distance is less than the sphere's radius, there is a collision
-    return distance < sphereRadius;
-}
-
-
-
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 {
     camera.ProcessMouseScroll(static_cast<float>(yoffset));
@@ -4,50 +4,68 @@ out vec4 FragColor;
 in vec3 Normal;
 in vec3 FragPos;
 in vec2 TexCoord;
-in vec4 FragPosLightSpace;
 
-uniform vec3 lightPos;
-uniform vec3 viewPos;
-uniform vec3 lightColor;
+// Per-frame camera and lighting, shared by every program (FrameUniformData in UniformBuffer.h)
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+    vec3 lightPos;
+    vec3 lightColor;
+    vec3 skyColor;      // hemisphere ambient: sky blue for now
+    vec3 groundColor;   // a bit browny this time
+};
 
-// --- NEW: Hemisphere lighting uniforms ---
-uniform vec3 skyColor; // which is sky blue for now
-uniform vec3 groundColor; // a bit browny this time
+// Shadow cascades (ShadowUniformData in UniformBuffer.h). Cascade i covers view depths up to
+// cascadeSplits[i] and is layer i of shadowMap.
+layout (std140) uniform ShadowData {
+    mat4 cascadeMatrices[4];
+    vec4 cascadeSplits;
+    vec4 cascadeBias;   // depth bias of each cascade, in its own depth units
+};
 
 uniform sampler2D texture_diffuse1;
-uniform sampler2D shadowMap;
+uniform sampler2DArray shadowMap;
 
-float CalculateShadow(vec4 fragPosLightSpace) // Shadow Calculation Function
+float CalculateShadow(vec3 fragPos, float nDotL) // Shadow Calculation Function
 {
-    // Perform perspective divide to get normalized device coordinates [ -1, 1 ]
+    // Pick the first cascade that reaches this far from the camera
+    float viewDepth = -(view * vec4(fragPos, 1.0)).z;
+    int cascade = 0;
+    while (cascade < 3 && viewDepth > cascadeSplits[cascade])
+        cascade++;
+    if (viewDepth > cascadeSplits[3])
+        return 0.0;
+
+    // Into the cascade's light space, then from [ -1, 1 ] to texture coordinates [ 0, 1 ]
+    vec4 fragPosLightSpace = cascadeMatrices[cascade] * vec4(fragPos, 1.0);
     vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
-    // Transform to texture coordinates [ 0, 1 ]
     projCoords = projCoords * 0.5 + 0.5;
 
     // Get depth of current fragment from light's perspective
     float currentDepth = projCoords.z;
-    
-    // Add a small bias to prevent "shadow acne" artifacts
-    float bias = 0.005;
+
+    // Bias against "shadow acne": about two texels of this cascade, more on surfaces turned away from the light
+    float bias = cascadeBias[cascade] * (1.0 + 2.0 * (1.0 - nDotL));
 
     // Sample the shadow map with Percentage-Closer Filtering (PCF) for softer shadow edges
     float shadow = 0.0;
-    vec2 texelSize = 1.0 / textureSize(shadowMap, 0); // calculates the size of a single texel
+    vec2 texelSize = 1.0 / vec2(textureSize(shadowMap, 0).xy); // calculates the size of a single texel
     for(int x = -1; x <= 1; ++x)
     {
         for(int y = -1; y <= 1; ++y)
         {
-            float pcfDepth = texture(shadowMap, projCoords.xy + vec2(x, y) * texelSize).r; 
+            float pcfDepth = texture(shadowMap, vec3(projCoords.xy + vec2(x, y) * texelSize, float(cascade))).r;
             if(pcfDepth < currentDepth - bias)
-                shadow += 1.0;        
+                shadow += 1.0;
         }
     }
     shadow /= 9.0;
-    
+
     // Don't cast shadows into the void
     if(projCoords.z > 1.0)
         shadow = 0.0;
-        
+
     return shadow;
 }
 
@@ -68,7 +86,7 @@ void main()
     vec3 diffuse = diff * lightColor * diffuseStrength;
 
     // --- APPLY THE SHADOW ---
-    float shadow = CalculateShadow(FragPosLightSpace); // <-- ADD THIS
+    float shadow = CalculateShadow(FragPos, diff);
     
     // Combine lighting: The shadow only affects the direct (diffuse) light, not the ambient light.
     vec3 result = (ambient + (1.0 - shadow) * diffuse) * objectColor; // <-- MODIFY THIS
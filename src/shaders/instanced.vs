@@ -0,0 +1,91 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+
+// Per-instance data (see InstanceData in InstanceBuffer.h)
+layout (location = 3) in vec4 iPosScale;   // xyz = world position, w = uniform scale
+layout (location = 4) in vec4 iParams;     // meaning depends on instanceMode
+
+// Same outputs as vertex.glsl, so fragment.glsl is reused as-is
+out vec3 FragPos;
+out vec3 Normal;
+out vec2 TexCoord;
+
+// Per-frame camera and lighting, shared by every program (FrameUniformData in UniformBuffer.h)
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+    vec3 lightPos;
+    vec3 lightColor;
+    vec3 skyColor;
+    vec3 groundColor;
+};
+
+// Shadow pass transform (PassUniformData in UniformBuffer.h), used when depthOnly is set
+layout (std140) uniform PassData {
+    mat4 lightSpaceMatrix;
+};
+
+// Set for the depth-only program (instanced.vs + shadow_depth.fs) that draws instances into a shadow cascade
+uniform bool depthOnly;
+
+// 0 = aircraft   (iParams.x = yaw in radians, iParams.y = propeller angle in degrees)
+// 1 = projectile (iParams.xyz = normalized flight direction)
+// 2 = explosion  (position + scale only)
+uniform int instanceMode;
+
+// Propeller spin, applied when the mesh being drawn is the propeller
+uniform bool spinPropeller;
+uniform vec3 propellerOffset;   // moves the propeller to the nose
+uniform vec3 propellerPivot;    // spin centre (in scaled model space)
+
+mat3 rotateY(float a)
+{
+    float c = cos(a), s = sin(a);
+    return mat3(c, 0.0, -s,   0.0, 1.0, 0.0,   s, 0.0, c);
+}
+
+mat3 rotateZ(float a)
+{
+    float c = cos(a), s = sin(a);
+    return mat3(c, s, 0.0,   -s, c, 0.0,   0.0, 0.0, 1.0);
+}
+
+// Orientation for a projectile flying along dir. Equivalent to the old CPU-side
+// inverse(lookAt(0, dir, up)) * rotate(90deg, Y): the model's +X axis ends up along dir.
+mat3 projectileBasis(vec3 dir)
+{
+    vec3 up = abs(dir.y) > 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(0.0, 1.0, 0.0);
+    vec3 side = normalize(cross(dir, up));
+    vec3 realUp = cross(side, dir);
+    return mat3(dir, realUp, side);
+}
+
+void main()
+{
+    vec3 localPos = decodePosition(aPos) * iPosScale.w;
+    vec3 localNormal = decodeNormal(aNormal);
+    mat3 orientation = mat3(1.0);
+
+    if (instanceMode == 0)
+    {
+        if (spinPropeller)
+        {
+            mat3 spin = rotateZ(radians(iParams.y));
+            localPos = spin * (localPos - propellerPivot) + propellerPivot + propellerOffset;
+            localNormal = spin * localNormal;
+        }
+        orientation = rotateY(iParams.x);
+    }
+    else if (instanceMode == 1)
+    {
+        orientation = projectileBasis(iParams.xyz);
+    }
+
+    FragPos = orientation * localPos + iPosScale.xyz;
+    Normal = orientation * localNormal; // rotation + uniform scale only, so no inverse-transpose needed
+    TexCoord = aTexCoords;
+    gl_Position = depthOnly ? lightSpaceMatrix * vec4(FragPos, 1.0) : projection * view * vec4(FragPos, 1.0);
+}
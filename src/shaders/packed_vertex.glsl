@@ -0,0 +1,28 @@
+// Prepended to every vertex shader by Shader (right after #version), so it comes before the
+// attribute declarations and takes the attributes as parameters.
+//
+// Meshes uploaded as PackedVertex (Model.h) are dequantized here: the position holds 16-bit steps
+// of positionScale from positionOffset, the normal's xy an octahedral normal in steps of 1/32767
+// and texture coordinates half floats, which need nothing.
+uniform bool packedVertices;
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
+vec3 octDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+vec3 decodePosition(vec3 position)
+{
+    return packedVertices ? positionOffset + position * positionScale : position;
+}
+
+vec3 decodeNormal(vec3 normal)
+{
+    return packedVertices ? octDecode(normal.xy / 32767.0) : normal;
+}
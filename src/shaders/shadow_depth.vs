@@ -1,10 +1,14 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
 
-uniform mat4 lightSpaceMatrix;
 uniform mat4 model;
 
+// Shadow pass transform (PassUniformData in UniformBuffer.h)
+layout (std140) uniform PassData {
+    mat4 lightSpaceMatrix;
+};
+
 void main()
 {
-    gl_Position = lightSpaceMatrix * model * vec4(aPos, 1.0);
+    gl_Position = lightSpaceMatrix * model * vec4(decodePosition(aPos), 1.0);
 }
\ No newline at end of file
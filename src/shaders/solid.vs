@@ -6,12 +6,21 @@ out vec3 FragPos;
 out vec3 Normal;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+
+// Per-frame camera and lighting, shared by every program (FrameUniformData in UniformBuffer.h)
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+    vec3 lightPos;
+    vec3 lightColor;
+    vec3 skyColor;
+    vec3 groundColor;
+};
 
 void main()
 {
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;
+    FragPos = vec3(model * vec4(decodePosition(aPos), 1.0));
+    Normal = mat3(transpose(inverse(model))) * decodeNormal(aNormal);
     gl_Position = projection * view * vec4(FragPos, 1.0);
 }
\ No newline at end of file
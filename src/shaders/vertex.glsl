@@ -7,27 +7,31 @@ layout (location = 2) in vec2 aTexCoords;
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoord;
-out vec4 FragPosLightSpace;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-uniform mat4 lightSpaceMatrix;
+
+// Per-frame camera and lighting, shared by every program (FrameUniformData in UniformBuffer.h)
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+    vec3 lightPos;
+    vec3 lightColor;
+    vec3 skyColor;
+    vec3 groundColor;
+};
 
 void main()
 {
     // Pass world-space position to the fragment shader
-    FragPos = vec3(model * vec4(aPos, 1.0));
+    FragPos = vec3(model * vec4(decodePosition(aPos), 1.0));
 
     // Calculate and pass the normal in world space
-    Normal = mat3(transpose(inverse(model))) * aNormal;   
+    Normal = mat3(transpose(inverse(model))) * decodeNormal(aNormal);   
     
     // Pass the texture coordinates through
     TexCoord = aTexCoords; // <-- THE MISSING ASSIGNMENT
 
-    // Calculate the vertex position from the light's perspective for the shadow map
-    FragPosLightSpace = lightSpaceMatrix * vec4(FragPos, 1.0);
-
     // Calculate the final clip-space position
     gl_Position = projection * view * vec4(FragPos, 1.0);
 }
@@ -0,0 +1,122 @@
+// Benchmark and cross-check for the simulation kernels (SimKernels.h).
+// Runs every kernel level this CPU supports on the same random enemies and bullets, checks each
+// against the scalar version and prints entities updated per second.
+//
+//   SimKernelBench [entities] [steps]
+
+#include "EntityPool.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+const float STEP = 1.0f / 120.0f;
+const float POSITION_TOLERANCE = 1e-3f;     // after the check's steps, in world units
+const float ANGLE_TOLERANCE = 1e-4f;        // radians for yaw, degrees for the propeller
+
+struct World {
+    EnemyPool enemies;
+    ProjectilePool projectiles;
+    std::vector<unsigned char> blocked;
+};
+
+World MakeWorld(uint32_t count)
+{
+    World world;
+    std::mt19937 rng(371);
+    std::uniform_real_distribution<float> position(-4000.0f, 4000.0f);
+    std::uniform_real_distribution<float> speed(35.0f, 40.0f);
+    std::uniform_real_distribution<float> direction(-1.0f, 1.0f);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        glm::vec3 pos(position(rng), 500.0f, position(rng));
+        glm::vec3 target(position(rng) * 0.05f, 400.0f, position(rng) * 0.05f);
+        if (i % 97 == 0)
+            target = pos;   // already there: no direction, yaw must stay put
+        world.enemies.spawn(pos, target, speed(rng));
+        world.enemies.propellerAngle[i] = (float)(i % 360);
+        world.projectiles.spawn(pos, glm::vec3(direction(rng), direction(rng), direction(rng)) * 200.0f, 6.0f);
+        world.blocked.push_back(i % 5 == 0 ? 1 : 0);
+    }
+    return world;
+}
+
+void Step(World &world)
+{
+    world.enemies.steer(STEP, world.blocked, 20.0f);
+    world.projectiles.integrate(STEP);
+}
+
+float AngleDifference(float a, float b, float turn)
+{
+    float d = std::fabs(a - b);
+    return std::fmin(d, std::fabs(turn - d));
+}
+
+// Number of entities outside tolerance
+uint32_t Compare(const World &a, const World &b)
+{
+    const float pi = 3.14159265f;
+    uint32_t bad = 0;
+    for (uint32_t i = 0; i < a.enemies.size(); i++)
+    {
+        bool ok = glm::length(a.enemies.position(i) - b.enemies.position(i)) <= POSITION_TOLERANCE
+               && AngleDifference(a.enemies.yaw[i], b.enemies.yaw[i], 2.0f * pi) <= ANGLE_TOLERANCE
+               && AngleDifference(a.enemies.propellerAngle[i], b.enemies.propellerAngle[i], 360.0f) <= ANGLE_TOLERANCE
+               && a.enemies.reachedTarget[i] == b.enemies.reachedTarget[i];
+        ok = ok && glm::length(a.projectiles.position(i) - b.projectiles.position(i)) <= POSITION_TOLERANCE
+                && std::fabs(a.projectiles.life[i] - b.projectiles.life[i]) <= 1e-5f;
+        bad += ok ? 0 : 1;
+    }
+    return bad;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t count = argc > 1 ? (uint32_t)std::atoi(argv[1]) : 100003;    // odd, so the scalar tails run too
+    int steps = argc > 2 ? std::atoi(argv[2]) : 500;
+
+    SimKernelLevel supported = SimKernels::detectLevel();
+    std::cout << "Simulation kernels: " << count << " enemies + " << count << " bullets, "
+              << steps << " steps, CPU supports " << SimKernelLevelName(supported) << std::endl;
+
+    // Reference: a few steps with the scalar kernels
+    const int checkSteps = 8;
+    SimKernels::setLevel(SIM_SCALAR);
+    World reference = MakeWorld(count);
+    for (int s = 0; s < checkSteps; s++)
+        Step(reference);
+
+    bool failed = false;
+    double scalarRate = 0.0;
+    for (int level = SIM_SCALAR; level <= supported; level++)
+    {
+        SimKernels::setLevel((SimKernelLevel)level);
+
+        World check = MakeWorld(count);
+        for (int s = 0; s < checkSteps; s++)
+            Step(check);
+        uint32_t bad = Compare(reference, check);
+        failed |= bad > 0;
+
+        World world = MakeWorld(count);
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int s = 0; s < steps; s++)
+            Step(world);
+        double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+        double rate = (double)count * 2.0 * steps / seconds;
+        if (level == SIM_SCALAR)
+            scalarRate = rate;
+
+        std::cout << "  " << SimKernelLevelName((SimKernelLevel)level) << ": "
+                  << rate / 1e6 << " M entities/s (" << rate / scalarRate << "x scalar), "
+                  << (bad ? std::to_string(bad) + " outside tolerance" : std::string("matches scalar")) << std::endl;
+    }
+
+    if (failed)
+        std::cout << "ERROR::SIM_BENCH::KERNEL_MISMATCH" << std::endl;
+    return failed ? 1 : 0;
+}